@@ -0,0 +1,169 @@
+#include "archive_stream.h"
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <memory>
+#include <algorithm>
+
+// 填充用的全0数据，以零拷贝方式引用
+static const char ZEROS[4096] = {};
+
+// ustar头部中的数字字段：八进制，以'\0'结尾；放不下时使用GNU的base-256编码(最高位为1，其余为大端整数)
+static void put_number(char *field, size_t width, uint64_t value)
+{
+  if (width < 12 || value < (1ull << (3 * (width - 1))))
+  {
+    snprintf(field, width, "%0*llo", (int)(width - 1), (unsigned long long)value);
+    return;
+  }
+  memset(field, 0, width);
+  field[0] = (char)0x80;
+  for (size_t i = width - 1; i > 0 && value > 0; i--)
+  {
+    field[i] = (char)(value & 0xff);
+    value >>= 8;
+  }
+}
+
+archive_stream::archive_stream(const std::string &dir)
+    : m_dir(dir), m_next(0), m_size(2 * BLOCK_SIZE)
+{
+}
+
+bool archive_stream::add(const std::string &name)
+{
+  return add_path(name, upload_layout::path(m_dir, name));
+}
+
+bool archive_stream::add_path(const std::string &name, const std::string &path)
+{
+  struct stat st;
+  if (stat(path.c_str(), &st) < 0 || !S_ISREG(st.st_mode))
+  {
+    return false;
+  }
+
+  member m = {name, path, (uint64_t)st.st_size, st.st_mtime};
+  if (name.size() > 100)
+  {
+    std::string record = pax_record(name);
+    m_size += BLOCK_SIZE + record.size() + padding(record.size());
+  }
+  m_size += BLOCK_SIZE + m.size + padding(m.size);
+  m_members.push_back(std::move(m));
+  return true;
+}
+
+void archive_stream::add_all()
+{
+  // 遍历时已经跳过描述文件、上传中的临时文件和blob目录
+  upload_walker walker(m_dir);
+  std::string name, path;
+  while (walker.next(name, path))
+  {
+    add_path(name, path);
+  }
+}
+
+// pax扩展头部中的path记录："长度 path=文件名\n"，长度包括表示长度的数字本身
+std::string archive_stream::pax_record(const std::string &name)
+{
+  size_t base = strlen(" path=") + name.size() + 1;
+  size_t len = base + 1;
+  while (std::to_string(len).size() + base != len)
+  {
+    len = std::to_string(len).size() + base;
+  }
+  return std::to_string(len) + " path=" + name + "\n";
+}
+
+void archive_stream::append_zeros(uint64_t n, response_buffer &out)
+{
+  while (n > 0)
+  {
+    size_t len = std::min<uint64_t>(n, sizeof(ZEROS));
+    out.append_external(ZEROS, len, nullptr);
+    n -= len;
+  }
+}
+
+void archive_stream::append_header(const std::string &name, char type, uint64_t size, time_t mtime, response_buffer &out)
+{
+  char block[BLOCK_SIZE] = {};
+  memcpy(block, name.data(), std::min<size_t>(name.size(), 100));
+  put_number(block + 100, 8, 0644);     // mode
+  put_number(block + 108, 8, 0);        // uid
+  put_number(block + 116, 8, 0);        // gid
+  put_number(block + 124, 12, size);    // size
+  put_number(block + 136, 12, mtime);   // mtime
+  block[156] = type;                    // typeflag
+  memcpy(block + 257, "ustar\0" "00", 8); // magic和version
+
+  // 校验和是头部所有字节之和，计算时校验和字段按8个空格计
+  memset(block + 148, ' ', 8);
+  unsigned int sum = 0;
+  for (size_t i = 0; i < BLOCK_SIZE; i++)
+  {
+    sum += (unsigned char)block[i];
+  }
+  snprintf(block + 148, 8, "%06o", sum);
+
+  out.append(std::string_view(block, BLOCK_SIZE));
+}
+
+void archive_stream::append_member_header(const member &m, response_buffer &out)
+{
+  // 文件名放不进ustar的name字段，先用pax扩展头部记录完整的文件名
+  if (m.name.size() > 100)
+  {
+    std::string record = pax_record(m.name);
+    append_header("PaxHeader/" + m.name.substr(0, 90), 'x', record.size(), m.mtime, out);
+    out.append(record);
+    append_zeros(padding(record.size()), out);
+  }
+  append_header(m.name, '0', m.size, m.mtime, out);
+}
+
+bool archive_stream::next(response_buffer &out)
+{
+  uint64_t batch_bytes = 0;
+  int batch_files = 0;
+  while (m_next < m_members.size() && batch_bytes < BATCH_BYTES && batch_files < BATCH_FILES)
+  {
+    const member &m = m_members[m_next++];
+    append_member_header(m, out);
+
+    // 文件内容按stat时的长度零拷贝引用，文件窗口持有fd直到发送完成
+    uint64_t sent = 0;
+    int fd = open(m.path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+      sent = std::min<uint64_t>(st.st_size, m.size);
+      out.append_file(std::make_shared<file_window>(fd, sent), 0, sent);
+      fd = -1;
+    }
+    if (fd >= 0)
+    {
+      close(fd);
+    }
+    if (sent < m.size)
+    {
+      printf("打包的文件 %s 在发送前变短或被删除，缺少的部分以0填充\n", m.name.c_str());
+    }
+    append_zeros(m.size - sent + padding(m.size), out);
+
+    batch_bytes += m.size;
+    batch_files++;
+  }
+
+  if (m_next < m_members.size())
+  {
+    return false;
+  }
+  // 归档以两个全0块结束
+  append_zeros(2 * BLOCK_SIZE, out);
+  return true;
+}
@@ -0,0 +1,67 @@
+#ifndef ARCHIVE_STREAM_H
+#define ARCHIVE_STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include "response_buffer.h"
+#include "upload_layout.h"
+
+/*
+    上传目录中多个文件的打包下载，边发送边生成tar(ustar格式)归档
+    - 添加成员时只stat文件，归档总长度在发送之前就能确定，响应可以带Content-Length
+    - 每个成员的512字节头部在内存中生成，文件内容通过append_file按窗口零拷贝引用，不生成临时归档
+    - next每次只打开一批成员，上一批发送完再生成下一批，打开的文件数和内存占用与归档大小无关
+    - 成员在stat之后被修改时仍按stat时的长度发送：变长的只发送前面的部分，变短或被删除的以0补齐，归档格式始终正确
+    - 超过100字节的文件名通过pax扩展头部记录
+    - 成员按上传目录的分层布局查找，归档中只记录文件名
+    - add/add_all/next会访问文件系统，只应在磁盘I/O线程中调用
+*/
+class archive_stream
+{
+public:
+  static const uint64_t BATCH_BYTES = 4 * 1024 * 1024; // 每批成员内容的大致总长度
+  static const int BATCH_FILES = 64;                   // 每批最多打开的文件数
+
+  explicit archive_stream(const std::string &dir);
+
+  archive_stream(const archive_stream &) = delete;
+  archive_stream &operator=(const archive_stream &) = delete;
+
+  // 添加目录中的一个文件，不存在或不是普通文件时返回false
+  bool add(const std::string &name);
+  // 添加目录中所有可见的普通文件(不以.开头)
+  void add_all();
+
+  uint64_t size() const { return m_size; } // 整个归档的长度
+
+  // 把下一批成员追加到out，返回true表示归档已经全部追加(包括结尾的两个空块)
+  bool next(response_buffer &out);
+
+private:
+  static const size_t BLOCK_SIZE = 512;
+
+  struct member
+  {
+    std::string name;
+    std::string path; // 实际路径
+    uint64_t size;
+    time_t mtime;
+  };
+
+  bool add_path(const std::string &name, const std::string &path);
+  static std::string pax_record(const std::string &name);
+  static uint64_t padding(uint64_t size) { return (BLOCK_SIZE - size % BLOCK_SIZE) % BLOCK_SIZE; }
+  static void append_zeros(uint64_t n, response_buffer &out);
+  static void append_header(const std::string &name, char type, uint64_t size, time_t mtime, response_buffer &out);
+  void append_member_header(const member &m, response_buffer &out);
+
+  std::string m_dir;
+  std::vector<member> m_members;
+  size_t m_next;   // 下一个要追加的成员
+  uint64_t m_size;
+};
+
+#endif
@@ -0,0 +1,171 @@
+#include "chunked_decoder.h"
+#include <string.h>
+#include <algorithm>
+
+// 块大小最多15个十六进制位，累加时不会溢出
+static const size_t MAX_SIZE_DIGITS = 15;
+
+static int hex_value(char c)
+{
+  if (c >= '0' && c <= '9')
+  {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f')
+  {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F')
+  {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+chunked_decoder::chunked_decoder(int64_t max_size)
+    : m_max_size(max_size), m_body_size(0), m_state(SIZE), m_status(MORE),
+      m_chunk_left(0), m_digits(0), m_line_size(0), m_trailer_size(0)
+{
+}
+
+chunked_decoder::STATUS chunked_decoder::fail(STATUS status)
+{
+  m_status = status;
+  return status;
+}
+
+chunked_decoder::STATUS chunked_decoder::decode(const char *in, size_t len, char *out, size_t out_space,
+                                                size_t &consumed, size_t &produced)
+{
+  consumed = 0;
+  produced = 0;
+  while (m_status == MORE && consumed < len)
+  {
+    // 块数据整段拷贝，其余状态逐字节处理
+    if (m_state == DATA)
+    {
+      size_t n = std::min<uint64_t>(std::min(len - consumed, out_space - produced), m_chunk_left);
+      if (n == 0)
+      {
+        // 输出空间已满
+        break;
+      }
+      memmove(out + produced, in + consumed, n);
+      consumed += n;
+      produced += n;
+      m_body_size += n;
+      m_chunk_left -= n;
+      if (m_chunk_left == 0)
+      {
+        m_state = DATA_CR;
+      }
+      continue;
+    }
+
+    char c = in[consumed++];
+    switch (m_state)
+    {
+    case SIZE:
+    {
+      int v = hex_value(c);
+      if (v >= 0)
+      {
+        if (++m_digits > MAX_SIZE_DIGITS)
+        {
+          return fail(BAD);
+        }
+        m_chunk_left = m_chunk_left * 16 + v;
+      }
+      else if (m_digits == 0)
+      {
+        // 块大小至少要有一位数字
+        return fail(BAD);
+      }
+      else if (c == ';' || c == ' ' || c == '\t')
+      {
+        m_state = EXTENSION;
+      }
+      else if (c == '\r')
+      {
+        m_state = SIZE_LF;
+      }
+      else
+      {
+        return fail(BAD);
+      }
+      break;
+    }
+    case EXTENSION:
+      if (c == '\r')
+      {
+        m_state = SIZE_LF;
+      }
+      else if (++m_line_size > MAX_LINE_SIZE)
+      {
+        return fail(BAD);
+      }
+      break;
+    case SIZE_LF:
+      if (c != '\n')
+      {
+        return fail(BAD);
+      }
+      // 块大小行读完，之前的块都已解码完，数据到达之前先检查总长度
+      if ((uint64_t)(m_max_size - m_body_size) < m_chunk_left)
+      {
+        return fail(TOO_LARGE);
+      }
+      m_digits = 0;
+      m_line_size = 0;
+      m_state = m_chunk_left == 0 ? TRAILER : DATA;
+      break;
+    case DATA_CR:
+      if (c != '\r')
+      {
+        return fail(BAD);
+      }
+      m_state = DATA_LF;
+      break;
+    case DATA_LF:
+      if (c != '\n')
+      {
+        return fail(BAD);
+      }
+      m_state = SIZE;
+      break;
+    case TRAILER:
+    case TRAILER_LINE:
+      if (++m_trailer_size > MAX_TRAILER_SIZE)
+      {
+        return fail(BAD);
+      }
+      if (c == '\r')
+      {
+        // 行首的\r是结束空行，否则是尾部字段行的结尾
+        m_state = m_state == TRAILER ? FINAL_LF : TRAILER_LF;
+      }
+      else
+      {
+        m_state = TRAILER_LINE;
+      }
+      break;
+    case TRAILER_LF:
+      if (c != '\n')
+      {
+        return fail(BAD);
+      }
+      m_state = TRAILER;
+      break;
+    case FINAL_LF:
+      if (c != '\n')
+      {
+        return fail(BAD);
+      }
+      m_status = DONE;
+      break;
+    default:
+      break;
+    }
+  }
+  return m_status;
+}
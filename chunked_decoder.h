@@ -0,0 +1,67 @@
+#ifndef CHUNKED_DECODER_H
+#define CHUNKED_DECODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+    分块传输编码(Transfer-Encoding: chunked)请求体的增量解码器
+    - 字节到达多少解码多少，块大小行、块扩展和尾部字段跨越多次读取时由状态机保存进度，不需要缓冲整个请求体
+    - 输出可以与输入位于同一块内存(就地解码)，数据部分总是不长于原始字节
+    - 块大小行解析完就检查请求体总长度，超过上限时在数据到达之前拒绝
+    - 块扩展和尾部字段直接丢弃，但长度同样有上限
+*/
+class chunked_decoder
+{
+public:
+  static const size_t MAX_LINE_SIZE = 1024;    // 块大小行(含扩展)的最大长度
+  static const size_t MAX_TRAILER_SIZE = 4096; // 尾部字段的最大总长度
+
+  enum STATUS
+  {
+    MORE,     // 请求体还没有结束，需要更多输入
+    DONE,     // 已收到最后一块和尾部，请求体结束
+    BAD,      // 编码格式错误
+    TOO_LARGE // 请求体超过大小上限
+  };
+
+  // max_size为解码后请求体的最大长度
+  explicit chunked_decoder(int64_t max_size);
+
+  // 解码in中的len个字节，数据部分写入out，out最多写入out_space个字节，可以与in相同
+  // consumed返回消耗的输入字节数，produced返回写入out的字节数
+  // 输出空间用完、请求体结束或出错时不再消耗输入，之后的字节由调用者处理
+  STATUS decode(const char *in, size_t len, char *out, size_t out_space, size_t &consumed, size_t &produced);
+
+  STATUS status() const { return m_status; }
+  bool failed() const { return m_status == BAD || m_status == TOO_LARGE; }
+  int64_t body_size() const { return m_body_size; } // 已解码的请求体长度
+
+private:
+  enum STATE
+  {
+    SIZE,         // 块大小的十六进制数字
+    EXTENSION,    // 块扩展，跳过直到行尾
+    SIZE_LF,      // 块大小行末尾的\n
+    DATA,         // 块数据
+    DATA_CR,      // 块数据之后的\r
+    DATA_LF,      // 块数据之后的\n
+    TRAILER,      // 尾部字段行的开头，空行表示请求体结束
+    TRAILER_LINE, // 尾部字段行，跳过直到行尾
+    TRAILER_LF,   // 尾部字段行末尾的\n
+    FINAL_LF      // 结束空行的\n
+  };
+
+  STATUS fail(STATUS status);
+
+  int64_t m_max_size;
+  int64_t m_body_size;
+  STATE m_state;
+  STATUS m_status;
+  uint64_t m_chunk_left; // 当前块还没有解码的数据字节数
+  size_t m_digits;       // 当前块大小已读入的十六进制位数
+  size_t m_line_size;    // 当前块大小行已读入的长度
+  size_t m_trailer_size; // 已读入的尾部字段总长度
+};
+
+#endif
@@ -0,0 +1,271 @@
+#include "compress_cache.h"
+#include <zlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <strings.h>
+#include <stdlib.h>
+
+int parse_accept_encoding(const std::string &value)
+{
+  int accepted = ENCODING_NONE;
+  size_t pos = 0;
+  while (pos < value.size())
+  {
+    size_t end = value.find(',', pos);
+    if (end == std::string::npos)
+    {
+      end = value.size();
+    }
+
+    // 每一项形如 "gzip;q=0.8"
+    std::string item = value.substr(pos, end - pos);
+    pos = end + 1;
+
+    size_t semi = item.find(';');
+    std::string name = item.substr(0, semi);
+    name.erase(0, name.find_first_not_of(" \t"));
+    name.erase(name.find_last_not_of(" \t") + 1);
+
+    if (semi != std::string::npos)
+    {
+      size_t q = item.find("q=", semi);
+      if (q != std::string::npos && atof(item.c_str() + q + 2) <= 0)
+      {
+        continue;
+      }
+    }
+
+    if (strcasecmp(name.c_str(), "gzip") == 0)
+    {
+      accepted |= ENCODING_GZIP;
+    }
+    else if (strcasecmp(name.c_str(), "br") == 0)
+    {
+      accepted |= ENCODING_BR;
+    }
+    else if (name == "*")
+    {
+      accepted |= ENCODING_GZIP | ENCODING_BR;
+    }
+  }
+  return accepted;
+}
+
+bool gzip_compress(const char *data, size_t len, std::string &out)
+{
+  z_stream zs = {};
+  // windowBits加16表示生成gzip头部和尾部
+  if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+  {
+    return false;
+  }
+
+  out.resize(deflateBound(&zs, len));
+  zs.next_in = (Bytef *)data;
+  zs.avail_in = len;
+  zs.next_out = (Bytef *)&out[0];
+  zs.avail_out = out.size();
+
+  int ret = deflate(&zs, Z_FINISH);
+  out.resize(zs.total_out);
+  deflateEnd(&zs);
+  return ret == Z_STREAM_END;
+}
+
+gzip_stream::gzip_stream() : m_zs(new z_stream())
+{
+  // 边生成边发送的内容使用默认压缩级别，减少请求路径上的CPU开销
+  if (deflateInit2(m_zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+  {
+    delete m_zs;
+    m_zs = NULL;
+  }
+}
+
+gzip_stream::~gzip_stream()
+{
+  if (m_zs)
+  {
+    deflateEnd(m_zs);
+    delete m_zs;
+  }
+}
+
+bool gzip_stream::write(std::string_view data, bool finish, std::string &out)
+{
+  if (!m_zs)
+  {
+    return false;
+  }
+
+  m_zs->next_in = (Bytef *)data.data();
+  m_zs->avail_in = data.size();
+  int flush = finish ? Z_FINISH : Z_SYNC_FLUSH;
+  int ret;
+  do
+  {
+    // 每轮至少预留输入大小的输出空间，不够时继续循环
+    size_t start = out.size();
+    size_t room = deflateBound(m_zs, m_zs->avail_in) + 64;
+    out.resize(start + room);
+    m_zs->next_out = (Bytef *)&out[start];
+    m_zs->avail_out = room;
+    ret = deflate(m_zs, flush);
+    out.resize(start + room - m_zs->avail_out);
+  } while (ret == Z_OK && (m_zs->avail_in > 0 || m_zs->avail_out == 0));
+
+  return finish ? ret == Z_STREAM_END : (ret == Z_OK || ret == Z_BUF_ERROR);
+}
+
+compress_cache &compress_cache::instance()
+{
+  static compress_cache cache;
+  return cache;
+}
+
+compress_cache::compress_cache() : m_pool(NULL), m_bytes(0)
+{
+  // 压缩是CPU密集型任务，只使用一个后台线程，避免抢占请求处理线程
+  m_pool = new threadpool<compress_task>(1, MAX_PENDING);
+}
+
+std::shared_ptr<const std::string> compress_cache::lookup(const std::string &key)
+{
+  std::shared_ptr<const std::string> data;
+  m_lock.lock();
+  auto it = m_entries.find(key);
+  if (it != m_entries.end())
+  {
+    m_lru.splice(m_lru.begin(), m_lru, it->second.lru_pos);
+    data = it->second.data;
+  }
+  m_lock.unlock();
+  return data;
+}
+
+bool compress_cache::begin_submit(const std::string &key)
+{
+  m_lock.lock();
+  bool ok = m_entries.find(key) == m_entries.end() &&
+            m_pending.size() < (size_t)MAX_PENDING &&
+            m_pending.insert(key).second;
+  m_lock.unlock();
+  return ok;
+}
+
+void compress_cache::submit_file(const std::string &key, const std::string &path, off_t size, int64_t mtime_ns)
+{
+  if ((size_t)size < MIN_SOURCE_SIZE || (size_t)size > MAX_SOURCE_SIZE || !begin_submit(key))
+  {
+    return;
+  }
+  compress_task *task = new compress_task{key, path, size, mtime_ns, nullptr};
+  if (!m_pool->append(task))
+  {
+    cancel(key);
+    delete task;
+  }
+}
+
+void compress_cache::submit_buffer(const std::string &key, std::shared_ptr<const std::string> data)
+{
+  if (data->size() < MIN_SOURCE_SIZE || data->size() > MAX_SOURCE_SIZE || !begin_submit(key))
+  {
+    return;
+  }
+  compress_task *task = new compress_task{key, "", 0, 0, std::move(data)};
+  if (!m_pool->append(task))
+  {
+    cancel(key);
+    delete task;
+  }
+}
+
+void compress_cache::insert(const std::string &key, std::shared_ptr<const std::string> data)
+{
+  m_lock.lock();
+  m_pending.erase(key);
+  if (m_entries.find(key) == m_entries.end())
+  {
+    m_lru.push_front(key);
+    m_bytes += data->size();
+    m_entries[key] = {std::move(data), m_lru.begin()};
+    evict();
+  }
+  m_lock.unlock();
+}
+
+void compress_cache::cancel(const std::string &key)
+{
+  m_lock.lock();
+  m_pending.erase(key);
+  m_lock.unlock();
+}
+
+// 淘汰最久未使用的条目直到总大小不超过上限，调用时已持有锁
+void compress_cache::evict()
+{
+  while (m_bytes > MAX_CACHE_BYTES && !m_lru.empty())
+  {
+    auto it = m_entries.find(m_lru.back());
+    m_bytes -= it->second.data->size();
+    m_entries.erase(it);
+    m_lru.pop_back();
+  }
+}
+
+void compress_task::process()
+{
+  compress_cache &cache = compress_cache::instance();
+  std::shared_ptr<const std::string> source = buffer;
+
+  if (!source)
+  {
+    // 读取文件，并确认文件在提交任务之后没有被修改
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0 || st.st_size != size ||
+        (int64_t)st.st_mtim.tv_sec * 1000000000ll + st.st_mtim.tv_nsec != mtime_ns)
+    {
+      if (fd >= 0)
+      {
+        close(fd);
+      }
+      cache.cancel(key);
+      delete this;
+      return;
+    }
+
+    auto content = std::make_shared<std::string>(size, '\0');
+    ssize_t total = 0;
+    while (total < size)
+    {
+      ssize_t n = pread(fd, &(*content)[total], size - total, total);
+      if (n <= 0)
+      {
+        break;
+      }
+      total += n;
+    }
+    close(fd);
+
+    if (total != size)
+    {
+      cache.cancel(key);
+      delete this;
+      return;
+    }
+    source = content;
+  }
+
+  auto compressed = std::make_shared<std::string>();
+  if (!gzip_compress(source->data(), source->size(), *compressed) ||
+      compressed->size() >= source->size() * 9 / 10)
+  {
+    // 压缩收益不明显，记录一个空结果，后续请求直接发送原始内容
+    compressed->clear();
+  }
+  cache.insert(key, compressed);
+  delete this;
+}
@@ -0,0 +1,109 @@
+#ifndef COMPRESS_CACHE_H
+#define COMPRESS_CACHE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <string>
+#include <string_view>
+#include <memory>
+#include <list>
+#include <unordered_map>
+#include <unordered_set>
+#include "locker.h"
+#include "threadpool.h"
+
+// Accept-Encoding中客户端可接受的压缩算法
+enum ENCODING
+{
+  ENCODING_NONE = 0,
+  ENCODING_GZIP = 1,
+  ENCODING_BR = 2
+};
+
+// 解析Accept-Encoding头部，返回ENCODING的按位组合，q=0的算法视为不接受
+int parse_accept_encoding(const std::string &value);
+
+// 使用zlib生成gzip格式的数据
+bool gzip_compress(const char *data, size_t len, std::string &out);
+
+struct z_stream_s;
+
+// 流式gzip压缩，用于边生成边发送的响应，每次写入的数据都立即刷新到输出，客户端可以马上解压
+class gzip_stream
+{
+public:
+  gzip_stream();
+  ~gzip_stream();
+
+  gzip_stream(const gzip_stream &) = delete;
+  gzip_stream &operator=(const gzip_stream &) = delete;
+
+  // 压缩data追加到out，finish为true时写入gzip尾部，之后不能再写入
+  bool write(std::string_view data, bool finish, std::string &out);
+
+private:
+  z_stream_s *m_zs; // 初始化失败时为空
+};
+
+struct compress_task;
+
+/*
+    压缩结果缓存
+    - 没有预压缩文件的热点文件和动态页面在后台线程中压缩一次，结果按总字节数有上限的LRU缓存
+    - 缓存的key包含内容版本(ETag或内容哈希)，同一版本的内容在请求路径上最多只压缩一次
+    - 未命中时提交后台任务并先返回未压缩内容，不阻塞请求
+*/
+class compress_cache
+{
+public:
+  static const size_t MAX_CACHE_BYTES = 32 * 1024 * 1024; // 缓存的压缩数据总大小上限
+  static const size_t MAX_SOURCE_SIZE = 8 * 1024 * 1024;  // 超过该大小的内容不进行压缩
+  static const size_t MIN_SOURCE_SIZE = 256;              // 太小的内容压缩收益不大
+  static const int MAX_PENDING = 64;                      // 排队中的压缩任务上限
+
+  static compress_cache &instance();
+
+  // 查找压缩结果，返回空指针表示未命中，返回空串表示压缩后没有变小，应发送原始内容
+  std::shared_ptr<const std::string> lookup(const std::string &key);
+
+  // 提交后台压缩任务，同一个key同时只会有一个任务在排队
+  void submit_file(const std::string &key, const std::string &path, off_t size, int64_t mtime_ns);
+  void submit_buffer(const std::string &key, std::shared_ptr<const std::string> data);
+
+  // 由压缩任务调用，保存压缩结果
+  void insert(const std::string &key, std::shared_ptr<const std::string> data);
+  void cancel(const std::string &key);
+
+private:
+  compress_cache();
+
+  bool begin_submit(const std::string &key);
+  void evict();
+
+  struct entry
+  {
+    std::shared_ptr<const std::string> data;
+    std::list<std::string>::iterator lru_pos;
+  };
+
+  threadpool<compress_task> *m_pool;
+  std::unordered_map<std::string, entry> m_entries;
+  std::list<std::string> m_lru; // 最近使用的在前面
+  std::unordered_set<std::string> m_pending;
+  size_t m_bytes;
+  locker m_lock;
+};
+
+// 后台压缩任务，由只有一个线程的线程池执行，执行完后释放自身
+struct compress_task
+{
+  std::string key;
+  std::string path;                          // 压缩文件时的路径
+  off_t size;                                // 提交时文件的大小和修改时间，读取时校验，防止缓存到新版本内容
+  int64_t mtime_ns;
+  std::shared_ptr<const std::string> buffer; // 压缩内存数据时的内容
+
+  void process();
+};
+
+#endif
@@ -0,0 +1,175 @@
+#include "content_store.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <openssl/evp.h>
+
+content_hash::content_hash() : m_ctx(EVP_MD_CTX_new())
+{
+  // OpenSSL根据CPU选择SHA-NI或AVX2实现
+  EVP_DigestInit_ex(m_ctx, EVP_sha256(), NULL);
+}
+
+content_hash::~content_hash()
+{
+  EVP_MD_CTX_free(m_ctx);
+}
+
+void content_hash::update(const char *data, size_t len)
+{
+  EVP_DigestUpdate(m_ctx, data, len);
+}
+
+std::string content_hash::hex()
+{
+  static const char DIGITS[] = "0123456789abcdef";
+  unsigned char md[EVP_MAX_MD_SIZE];
+  unsigned int len = 0;
+  EVP_DigestFinal_ex(m_ctx, md, &len);
+  std::string out(2 * len, '0');
+  for (unsigned int i = 0; i < len; i++)
+  {
+    out[2 * i] = DIGITS[md[i] >> 4];
+    out[2 * i + 1] = DIGITS[md[i] & 0xf];
+  }
+  return out;
+}
+
+content_store &content_store::instance()
+{
+  static content_store store;
+  return store;
+}
+
+// blob与上传的文件一样分两级子目录
+std::string content_store::blob_path(const std::string &hash) const
+{
+  return upload_layout::blob_path(m_dir + "/.blobs", hash);
+}
+
+void content_store::load(const std::string &dir)
+{
+  m_lock.lock();
+  m_dir = dir;
+  // blob目录只在这里创建一次，写入时make_parent_dirs只创建其下的两级子目录
+  std::string blob_dir = dir + "/.blobs";
+  if (mkdir(blob_dir.c_str(), 0755) < 0 && errno != EEXIST)
+  {
+    printf("创建blob目录失败: %s\n", strerror(errno));
+  }
+  upload_walker walker(blob_dir);
+  std::string hash, path;
+  while (walker.next(hash, path))
+  {
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode))
+    {
+      m_blobs[st.st_ino] = {hash, st.st_size};
+    }
+  }
+  printf("内容存储: 已有 %zu 个blob\n", m_blobs.size());
+  m_lock.unlock();
+}
+
+bool content_store::store(const std::string &temp_path, const std::string &hash, const std::string &path, bool &existed)
+{
+  // 临时链接与目标文件在同一目录，rename替换目标文件是原子的；同一时刻只有一个线程持有锁，名字不会冲突
+  std::string link_path = path.substr(0, path.rfind('/')) + "/.link_" + hash;
+
+  m_lock.lock();
+  std::string blob = blob_path(hash);
+  struct stat blob_stat;
+  if (stat(blob.c_str(), &blob_stat) == 0)
+  {
+    // 内容已经存在，丢弃这次写入的副本
+    unlink(temp_path.c_str());
+    printf("上传内容已存在，复用 %s\n", hash.c_str());
+  }
+  else
+  {
+    if (!upload_layout::make_parent_dirs(blob) || rename(temp_path.c_str(), blob.c_str()) < 0 ||
+        stat(blob.c_str(), &blob_stat) < 0)
+    {
+      printf("保存blob失败: %s\n", strerror(errno));
+      unlink(temp_path.c_str());
+      m_lock.unlock();
+      return false;
+    }
+    m_blobs[blob_stat.st_ino] = {hash, blob_stat.st_size};
+  }
+
+  struct stat old_stat;
+  existed = lstat(path.c_str(), &old_stat) == 0;
+  if (existed && old_stat.st_ino == blob_stat.st_ino)
+  {
+    // 同名文件的内容没有变化；rename两个指向同一inode的名字什么也不做，不需要新链接
+    m_lock.unlock();
+    return true;
+  }
+
+  unlink(link_path.c_str());
+  if (link(blob.c_str(), link_path.c_str()) < 0 || rename(link_path.c_str(), path.c_str()) < 0)
+  {
+    printf("链接上传文件失败: %s\n", strerror(errno));
+    unlink(link_path.c_str());
+    release(blob_stat);
+    m_lock.unlock();
+    return false;
+  }
+  if (existed)
+  {
+    release(old_stat);
+  }
+  m_lock.unlock();
+  return true;
+}
+
+bool content_store::remove(const std::string &path)
+{
+  m_lock.lock();
+  struct stat st;
+  bool ok = lstat(path.c_str(), &st) == 0 && unlink(path.c_str()) == 0;
+  if (ok)
+  {
+    release(st);
+  }
+  m_lock.unlock();
+  return ok;
+}
+
+// 一个引用已经删除，st是删除前的状态；只剩blob自身的链接时回收blob。调用者持有锁
+void content_store::release(const struct stat &st)
+{
+  auto it = m_blobs.find(st.st_ino);
+  if (it == m_blobs.end())
+  {
+    return;
+  }
+  std::string blob = blob_path(it->second.hash);
+  struct stat blob_stat;
+  if (stat(blob.c_str(), &blob_stat) == 0 && blob_stat.st_ino == st.st_ino && blob_stat.st_nlink == 1)
+  {
+    unlink(blob.c_str());
+    m_blobs.erase(it);
+    printf("回收blob %s\n", blob.c_str());
+  }
+}
+
+bool content_store::lookup(const struct stat &st, std::string &hash)
+{
+  // 普通文件只有一个链接，不需要查索引
+  if (st.st_nlink < 2 || !S_ISREG(st.st_mode))
+  {
+    return false;
+  }
+  m_lock.lock();
+  auto it = m_blobs.find(st.st_ino);
+  bool found = it != m_blobs.end() && it->second.size == st.st_size;
+  if (found)
+  {
+    hash = it->second.hash;
+  }
+  m_lock.unlock();
+  return found;
+}
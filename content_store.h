@@ -0,0 +1,77 @@
+#ifndef CONTENT_STORE_H
+#define CONTENT_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <string>
+#include <unordered_map>
+#include "locker.h"
+#include "upload_layout.h"
+
+typedef struct evp_md_ctx_st EVP_MD_CTX;
+
+// 上传内容的增量SHA-256，数据边接收边计算，不需要再读一遍文件
+class content_hash
+{
+public:
+  content_hash();
+  ~content_hash();
+
+  content_hash(const content_hash &) = delete;
+  content_hash &operator=(const content_hash &) = delete;
+
+  void update(const char *data, size_t len);
+  // 结束计算，返回64位十六进制的摘要，之后不能再update
+  std::string hex();
+
+private:
+  EVP_MD_CTX *m_ctx;
+};
+
+/*
+    上传目录的内容寻址存储
+    - 相同的内容只在 <上传目录>/.blobs/ab/c/<sha256> 保存一份，上传目录中的文件名是指向它的硬链接
+    - 引用计数就是inode的链接数：blob自身一个，每个文件名各一个；删除最后一个文件名时回收blob
+    - 文件名和blob是同一个inode，下载、文件列表、打包下载等读取路径不需要任何改动
+    - 内存中保存inode到摘要的索引，stat得到的inode可以直接查到内容哈希，用作强ETag
+    - 建立和删除链接都在同一把锁内完成，回收blob时不会与新的引用交错
+*/
+class content_store
+{
+public:
+  static content_store &instance();
+
+  // 启动时指定上传目录，扫描已有的blob，建立inode索引
+  void load(const std::string &dir);
+
+  // 把写完的临时文件按内容存入blob目录，再原子地把path替换为指向blob的链接
+  // 相同内容的blob已经存在时直接删除临时文件，existed返回path原来是否存在
+  bool store(const std::string &temp_path, const std::string &hash, const std::string &path, bool &existed);
+
+  // 删除path，它是blob的最后一个引用时一起回收blob
+  bool remove(const std::string &path);
+
+  // 文件是上传目录中的blob链接时返回true，hash为内容的摘要
+  bool lookup(const struct stat &st, std::string &hash);
+
+private:
+  content_store() {}
+
+  struct blob
+  {
+    std::string hash;
+    off_t size;
+  };
+
+  std::string blob_path(const std::string &hash) const;
+  void release(const struct stat &st);
+
+  std::string m_dir; // 上传目录
+
+  std::unordered_map<ino_t, blob> m_blobs; // blob的inode -> 摘要，上传目录只在一个文件系统上
+  locker m_lock;
+};
+
+#endif
@@ -0,0 +1,116 @@
+#include "dir_listing.h"
+#include "meta_store.h"
+
+dir_listing::dir_listing(std::string head, std::string tail, bool gzip)
+    : m_head(std::move(head)), m_tail(std::move(tail)), m_count(0)
+{
+  if (gzip)
+  {
+    m_gzip.reset(new gzip_stream);
+  }
+}
+
+void dir_listing::begin(std::string &out)
+{
+  emit(m_head, false, out);
+  m_head.clear();
+}
+
+bool dir_listing::next(std::string &out)
+{
+  std::string html;
+  std::vector<std::pair<std::string, file_meta>> page;
+  meta_store::instance().list_after(m_last, BATCH_SIZE, page);
+  int batch = 0;
+  for (const auto &entry : page)
+  {
+    const std::string &file = entry.first;
+    const file_meta &meta = entry.second;
+    const std::string &description = meta.description;
+
+    // 计算可读的文件大小
+    std::string size_str;
+    if (meta.size < 1024)
+    {
+      size_str = std::to_string(meta.size) + " B";
+    }
+    else if (meta.size < 1024 * 1024)
+    {
+      size_str = std::to_string(meta.size / 1024) + " KB";
+    }
+    else
+    {
+      size_str = std::to_string(meta.size / (1024 * 1024)) + " MB";
+    }
+
+    if (m_count++ == 0)
+    {
+      html += "<ul class=\"files\">\n";
+    }
+
+    // 添加文件链接、大小、描述和删除按钮
+    html += "  <li>\n";
+    html += "    <div>\n";
+    html += "      <a href=\"/uploads/" + file + "\">" + file + "</a>\n";
+    html += "      <span class=\"file-size\">" + size_str + "</span>\n";
+    if (!description.empty())
+    {
+      html += "      <div class=\"file-desc\">" + description + "</div>\n";
+    }
+    html += "    </div>\n";
+    html += "    <div class=\"file-actions\">\n";
+    html += "      <form action=\"/delete\" method=\"POST\">\n";
+    html += "        <input type=\"hidden\" name=\"filename\" value=\"" + file + "\">\n";
+    html += "        <button type=\"submit\" class=\"delete-btn\">删除</button>\n";
+    html += "      </form>\n";
+    html += "    </div>\n";
+    html += "  </li>\n";
+    batch++;
+  }
+  if (!page.empty())
+  {
+    m_last = page.back().first;
+  }
+
+  if (batch == BATCH_SIZE)
+  {
+    emit(html, false, out);
+    return false;
+  }
+
+  // 文件已列完，补上列表结尾和页面的剩余部分
+  if (m_count == 0)
+  {
+    // 如果没有文件，显示相应信息
+    html += "<p>目前没有文件，请到表单页面上传文件。</p>";
+  }
+  else
+  {
+    html += "</ul>\n";
+  }
+  html += m_tail;
+  emit(html, true, out);
+  return true;
+}
+
+std::string dir_listing::render()
+{
+  dir_listing listing("", "", false);
+  std::string html;
+  while (!listing.next(html))
+  {
+  }
+  return html;
+}
+
+void dir_listing::emit(const std::string &html, bool finish, std::string &out)
+{
+  if (m_gzip)
+  {
+    m_gzip->write(html, finish, out);
+  }
+  else
+  {
+    out += html;
+  }
+}
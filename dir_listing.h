@@ -0,0 +1,45 @@
+#ifndef DIR_LISTING_H
+#define DIR_LISTING_H
+
+#include <string>
+#include <memory>
+#include "compress_cache.h"
+
+/*
+    上传目录的文件列表页面，分批生成
+    - begin生成列表之前的页面部分，可以立即发送
+    - 文件名和大小、描述都来自元数据存储(meta_store.h)，生成列表不访问上传目录，没有逐个文件的系统调用
+    - 按文件名排序输出：next每次从元数据的排序索引中取出上一批最后一个文件名之后的一批，发送完后再取下一批
+    - 只记住上一批的最后一个文件名，内存占用与文件数量无关；生成期间的上传和删除不会造成重复或遗漏
+    - 客户端接受gzip时每批数据压缩后立即刷新，客户端可以边收边渲染
+*/
+class dir_listing
+{
+public:
+  static const int BATCH_SIZE = 64; // 每批最多列出的文件数
+
+  // head和tail是页面中文件列表之前和之后的部分
+  dir_listing(std::string head, std::string tail, bool gzip);
+
+  dir_listing(const dir_listing &) = delete;
+  dir_listing &operator=(const dir_listing &) = delete;
+
+  void begin(std::string &out);
+
+  // 生成下一批内容追加到out，返回true表示页面已经全部生成
+  bool next(std::string &out);
+
+  // 生成完整的文件列表(不含head和tail)
+  static std::string render();
+
+private:
+  void emit(const std::string &html, bool finish, std::string &out);
+
+  std::string m_head;
+  std::string m_tail;
+  std::string m_last; // 已列出的最后一个文件名
+  int m_count;        // 已列出的文件数
+  std::unique_ptr<gzip_stream> m_gzip; // 不压缩时为空
+};
+
+#endif
@@ -0,0 +1,229 @@
+#include "file_index.h"
+#include <algorithm>
+
+std::string file_index::fold(const std::string &s)
+{
+  std::string out(s);
+  for (char &c : out)
+  {
+    if (c >= 'A' && c <= 'Z')
+    {
+      c = c - 'A' + 'a';
+    }
+  }
+  return out;
+}
+
+// 取出所有不重复的三元组，按值排序
+void file_index::trigrams(const std::string &folded, std::vector<uint32_t> &out)
+{
+  out.clear();
+  for (size_t i = 0; i + 3 <= folded.size(); i++)
+  {
+    out.push_back((uint32_t)(unsigned char)folded[i] << 16 |
+                  (uint32_t)(unsigned char)folded[i + 1] << 8 |
+                  (uint32_t)(unsigned char)folded[i + 2]);
+  }
+  std::sort(out.begin(), out.end());
+  out.erase(std::unique(out.begin(), out.end()), out.end());
+}
+
+size_t file_index::lower_bound(const std::string &name) const
+{
+  return std::lower_bound(m_sorted.begin(), m_sorted.end(), name,
+                          [this](uint32_t id, const std::string &key)
+                          { return m_names[id] < key; }) -
+         m_sorted.begin();
+}
+
+// 新编号总是最大的，直接追加在列表末尾，列表保持递增
+void file_index::add_postings(uint32_t id)
+{
+  std::vector<uint32_t> grams;
+  trigrams(m_folded[id], grams);
+  for (uint32_t gram : grams)
+  {
+    m_postings[gram].push_back(id);
+  }
+}
+
+void file_index::build(std::vector<std::string> names)
+{
+  std::sort(names.begin(), names.end());
+  names.erase(std::unique(names.begin(), names.end()), names.end());
+
+  m_names = std::move(names);
+  m_folded.clear();
+  m_ids.clear();
+  m_sorted.clear();
+  m_postings.clear();
+  m_cache.clear();
+  m_folded.reserve(m_names.size());
+  m_ids.reserve(m_names.size());
+  m_sorted.reserve(m_names.size());
+  // 按排序后的顺序编号，排序数组就是0..n-1
+  for (uint32_t id = 0; id < m_names.size(); id++)
+  {
+    m_folded.push_back(fold(m_names[id]));
+    m_ids.emplace(m_names[id], id);
+    m_sorted.push_back(id);
+    add_postings(id);
+  }
+}
+
+void file_index::insert(const std::string &name)
+{
+  if (m_ids.count(name))
+  {
+    return;
+  }
+  uint32_t id = m_names.size();
+  m_names.push_back(name);
+  m_folded.push_back(fold(name));
+  m_ids.emplace(name, id);
+  m_sorted.insert(m_sorted.begin() + lower_bound(name), id);
+  add_postings(id);
+  m_cache.clear();
+}
+
+void file_index::erase(const std::string &name)
+{
+  auto it = m_ids.find(name);
+  if (it == m_ids.end())
+  {
+    return;
+  }
+  uint32_t id = it->second;
+  m_sorted.erase(m_sorted.begin() + lower_bound(name));
+
+  std::vector<uint32_t> grams;
+  trigrams(m_folded[id], grams);
+  for (uint32_t gram : grams)
+  {
+    auto posting = m_postings.find(gram);
+    std::vector<uint32_t> &ids = posting->second;
+    ids.erase(std::lower_bound(ids.begin(), ids.end(), id));
+    if (ids.empty())
+    {
+      m_postings.erase(posting);
+    }
+  }
+
+  m_ids.erase(it);
+  m_names[id].clear();
+  m_names[id].shrink_to_fit();
+  m_folded[id].clear();
+  m_folded[id].shrink_to_fit();
+  m_cache.clear();
+}
+
+// 找出所有包含folded的文件，ids按文件名排序
+void file_index::match(const std::string &folded, std::vector<uint32_t> &ids)
+{
+  ids.clear();
+  std::vector<uint32_t> grams;
+  trigrams(folded, grams);
+
+  // 各三元组的列表按长度排序，任何一个三元组不存在时没有匹配
+  std::vector<const std::vector<uint32_t> *> lists;
+  for (uint32_t gram : grams)
+  {
+    auto posting = m_postings.find(gram);
+    if (posting == m_postings.end())
+    {
+      return;
+    }
+    lists.push_back(&posting->second);
+  }
+  std::sort(lists.begin(), lists.end(),
+            [](const std::vector<uint32_t> *a, const std::vector<uint32_t> *b)
+            { return a->size() < b->size(); });
+
+  if (lists.empty() || lists[0]->size() > m_sorted.size() / 4)
+  {
+    // 查询串太短或太常见，按排序数组顺序逐个匹配，结果天然有序
+    for (uint32_t id : m_sorted)
+    {
+      if (m_folded[id].find(folded) != std::string::npos)
+      {
+        ids.push_back(id);
+      }
+    }
+    return;
+  }
+
+  // 候选和各列表都按编号递增，在每个列表中的查找位置只向后移动
+  std::vector<uint32_t> candidates(*lists[0]);
+  for (size_t i = 1; i < lists.size() && !candidates.empty(); i++)
+  {
+    auto from = lists[i]->begin();
+    size_t kept = 0;
+    for (uint32_t id : candidates)
+    {
+      from = std::lower_bound(from, lists[i]->end(), id);
+      if (from == lists[i]->end())
+      {
+        break;
+      }
+      if (*from == id)
+      {
+        candidates[kept++] = id;
+      }
+    }
+    candidates.resize(kept);
+  }
+  // 三元组都出现不代表连续出现，还要确认子串
+  for (uint32_t id : candidates)
+  {
+    if (m_folded[id].find(folded) != std::string::npos)
+    {
+      ids.push_back(id);
+    }
+  }
+  std::sort(ids.begin(), ids.end(),
+            [this](uint32_t a, uint32_t b)
+            { return m_names[a] < m_names[b]; });
+}
+
+void file_index::list_after(const std::string &after, size_t limit, std::vector<std::string> &page) const
+{
+  page.clear();
+  size_t i = after.empty() ? 0 : std::upper_bound(m_sorted.begin(), m_sorted.end(), after,
+                                                  [this](const std::string &key, uint32_t id)
+                                                  { return key < m_names[id]; }) -
+                                     m_sorted.begin();
+  for (; i < m_sorted.size() && page.size() < limit; i++)
+  {
+    page.push_back(m_names[m_sorted[i]]);
+  }
+}
+
+size_t file_index::search(const std::string &query, size_t offset, size_t limit, std::vector<std::string> &page)
+{
+  page.clear();
+  const std::vector<uint32_t> *ids = &m_sorted;
+  if (!query.empty())
+  {
+    std::string folded = fold(query);
+    auto cached = std::find_if(m_cache.begin(), m_cache.end(),
+                               [&folded](const cached_result &r)
+                               { return r.query == folded; });
+    if (cached == m_cache.end())
+    {
+      if (m_cache.size() >= CACHE_SIZE)
+      {
+        m_cache.erase(m_cache.begin());
+      }
+      m_cache.push_back({folded, {}});
+      match(folded, m_cache.back().ids);
+      cached = m_cache.end() - 1;
+    }
+    ids = &cached->ids;
+  }
+
+  for (size_t i = offset; i < ids->size() && i - offset < limit; i++)
+  {
+    page.push_back(m_names[(*ids)[i]]);
+  }
+  return ids->size();
+}
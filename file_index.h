@@ -0,0 +1,62 @@
+#ifndef FILE_INDEX_H
+#define FILE_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+/*
+    文件名的内存索引，支持按名字排序分页和子串搜索
+    - 每个文件名分配一个整数编号，新名字的编号总是最大的，删除后编号不再使用
+    - 按文件名排序的编号数组：不带搜索条件的分页直接取数组的一段，插入和删除时二分查找位置
+    - 三元组倒排索引：文件名(ASCII字母转为小写)的每个连续3字节对应一个按编号递增的列表
+    - 搜索时从查询串各三元组中最短的列表出发，依次与其余列表求交集，剩下的候选再用子串匹配确认
+    - 候选过多(超过文件数的1/4)或查询串不足3字节时直接按排序数组顺序匹配
+    - 最近的搜索结果按查询串缓存，同一查询翻页时不再重新匹配，索引变化时清空
+    - 不加锁，由调用者保证互斥
+*/
+class file_index
+{
+public:
+  static const size_t CACHE_SIZE = 16; // 缓存的搜索结果数
+
+  // 用names替换索引的全部内容，一次排序，比逐个插入快
+  void build(std::vector<std::string> names);
+  // 加入新的文件名，已存在时不做任何事
+  void insert(const std::string &name);
+  void erase(const std::string &name);
+  size_t size() const { return m_sorted.size(); }
+
+  // 按文件名顺序返回包含query(不区分ASCII大小写)的第offset个起最多limit个文件名，返回匹配的总数
+  // query为空时匹配所有文件
+  size_t search(const std::string &query, size_t offset, size_t limit, std::vector<std::string> &page);
+
+  // 按文件名顺序返回排在after之后的最多limit个文件名，after为空时从头开始
+  // 以文件名而不是位置续接，两次调用之间的插入和删除不会造成重复或遗漏
+  void list_after(const std::string &after, size_t limit, std::vector<std::string> &page) const;
+
+private:
+  struct cached_result
+  {
+    std::string query; // 转为小写的查询串
+    std::vector<uint32_t> ids;
+  };
+
+  static std::string fold(const std::string &s);
+  static void trigrams(const std::string &folded, std::vector<uint32_t> &out);
+  // 排序数组中第一个不小于name的位置
+  size_t lower_bound(const std::string &name) const;
+  void add_postings(uint32_t id);
+  void match(const std::string &folded, std::vector<uint32_t> &ids);
+
+  std::vector<std::string> m_names;  // 按编号保存的文件名，删除后为空
+  std::vector<std::string> m_folded; // 转为小写的文件名，用于匹配
+  std::unordered_map<std::string, uint32_t> m_ids;
+  std::vector<uint32_t> m_sorted; // 按文件名排序的编号
+  std::unordered_map<uint32_t, std::vector<uint32_t>> m_postings;
+  std::vector<cached_result> m_cache; // 最近的放在最后
+};
+
+#endif
@@ -0,0 +1,425 @@
+#include "hpack.h"
+
+// RFC 7541 附录B 霍夫曼编码表，下标为符号(256为EOS)
+static const struct
+{
+  uint32_t code;
+  uint8_t bits;
+} HUFFMAN_CODES[257] = {
+    {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28}, {0xfffffe4, 28}, {0xfffffe5, 28},
+    {0xfffffe6, 28}, {0xfffffe7, 28}, {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+    {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28}, {0xfffffed, 28}, {0xfffffee, 28},
+    {0xfffffef, 28}, {0xffffff0, 28}, {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+    {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28}, {0xffffff8, 28}, {0xffffff9, 28},
+    {0xffffffa, 28}, {0xffffffb, 28}, {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+    {0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11}, {0x3fa, 10}, {0x3fb, 10},
+    {0xf9, 8}, {0x7fb, 11}, {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+    {0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6}, {0x1a, 6}, {0x1b, 6},
+    {0x1c, 6}, {0x1d, 6}, {0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8},
+    {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10}, {0x1ffa, 13}, {0x21, 6},
+    {0x5d, 7}, {0x5e, 7}, {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+    {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7}, {0x67, 7}, {0x68, 7},
+    {0x69, 7}, {0x6a, 7}, {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+    {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7}, {0xfc, 8}, {0x73, 7},
+    {0xfd, 8}, {0x1ffb, 13}, {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+    {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5}, {0x24, 6}, {0x5, 5},
+    {0x25, 6}, {0x26, 6}, {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7},
+    {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5}, {0x2b, 6}, {0x76, 7},
+    {0x2c, 6}, {0x8, 5}, {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+    {0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15}, {0x7fc, 11}, {0x3ffd, 14},
+    {0x1ffd, 13}, {0xffffffc, 28}, {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20},
+    {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23}, {0x3fffd6, 22}, {0x7fffda, 23},
+    {0x7fffdb, 23}, {0x7fffdc, 23}, {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+    {0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23}, {0xffffee, 24}, {0x7fffe1, 23},
+    {0x7fffe2, 23}, {0x7fffe3, 23}, {0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23},
+    {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24}, {0x3fffda, 22}, {0x1fffdd, 21},
+    {0xfffe9, 20}, {0x3fffdb, 22}, {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+    {0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24}, {0x1fffdf, 21}, {0x3fffdf, 22},
+    {0x7fffeb, 23}, {0x7fffec, 23}, {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21},
+    {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23}, {0xfffea, 20}, {0x3fffe2, 22},
+    {0x3fffe3, 22}, {0x3fffe4, 22}, {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+    {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19}, {0x3fffe7, 22}, {0x7ffff2, 23},
+    {0x3fffe8, 22}, {0x1ffffec, 25}, {0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27},
+    {0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25}, {0x7fff2, 19}, {0x1fffe3, 21},
+    {0x3ffffe6, 26}, {0x7ffffe0, 27}, {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+    {0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26}, {0xffffffd, 28}, {0x7ffffe3, 27},
+    {0x7ffffe4, 27}, {0x7ffffe5, 27}, {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21},
+    {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23}, {0x3fffea, 22}, {0x3fffeb, 22},
+    {0x1ffffee, 25}, {0x1ffffef, 25}, {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+    {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26}, {0x7ffffe7, 27}, {0x7ffffe8, 27},
+    {0x7ffffe9, 27}, {0x7ffffea, 27}, {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27},
+    {0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26}, {0x3fffffff, 30},
+};
+
+// RFC 7541 附录A 静态表，下标从1开始
+static const hpack_header STATIC_TABLE[] = {
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+};
+
+static const size_t STATIC_TABLE_SIZE = sizeof(STATIC_TABLE) / sizeof(STATIC_TABLE[0]);
+
+// 解码后头部列表的总大小上限，防止头部炸弹
+static const size_t MAX_HEADER_LIST_SIZE = 64 * 1024;
+
+// 霍夫曼解码树，节点的两个子节点分别对应比特0和1，叶子节点保存符号
+struct huffman_node
+{
+  int16_t child[2];
+  int16_t symbol;
+};
+
+struct huffman_tree
+{
+  huffman_node nodes[513];
+  int count;
+
+  huffman_tree() : count(1)
+  {
+    nodes[0] = {{-1, -1}, -1};
+    for (int sym = 0; sym < 257; sym++)
+    {
+      int cur = 0;
+      for (int i = HUFFMAN_CODES[sym].bits - 1; i >= 0; i--)
+      {
+        int bit = (HUFFMAN_CODES[sym].code >> i) & 1;
+        if (nodes[cur].child[bit] < 0)
+        {
+          nodes[count] = {{-1, -1}, -1};
+          nodes[cur].child[bit] = count++;
+        }
+        cur = nodes[cur].child[bit];
+      }
+      nodes[cur].symbol = sym;
+    }
+  }
+};
+
+bool huffman_decode(const uint8_t *data, size_t len, std::string &out)
+{
+  static const huffman_tree tree;
+
+  int cur = 0;
+  int depth = 0;        // 距离上一个完整符号已经读入的比特数
+  bool all_ones = true; // 这些比特是否全为1，只有这样才是合法的填充
+  for (size_t i = 0; i < len; i++)
+  {
+    for (int b = 7; b >= 0; b--)
+    {
+      int bit = (data[i] >> b) & 1;
+      cur = tree.nodes[cur].child[bit];
+      if (cur < 0)
+      {
+        return false;
+      }
+      depth++;
+      all_ones = all_ones && bit;
+
+      int16_t sym = tree.nodes[cur].symbol;
+      if (sym >= 0)
+      {
+        // 解码出EOS是错误
+        if (sym == 256)
+        {
+          return false;
+        }
+        out.push_back(static_cast<char>(sym));
+        cur = 0;
+        depth = 0;
+        all_ones = true;
+      }
+    }
+  }
+  // 结尾的填充必须是EOS编码的前缀，即不超过7个1
+  return depth <= 7 && all_ones;
+}
+
+// 解码带前缀的整数(RFC 7541 5.1)
+static bool decode_int(const uint8_t *&p, const uint8_t *end, int prefix_bits, uint64_t &value)
+{
+  if (p >= end)
+  {
+    return false;
+  }
+  uint64_t max_prefix = (1u << prefix_bits) - 1;
+  value = *p++ & max_prefix;
+  if (value < max_prefix)
+  {
+    return true;
+  }
+
+  int shift = 0;
+  while (p < end)
+  {
+    uint8_t b = *p++;
+    value += (uint64_t)(b & 0x7f) << shift;
+    if (!(b & 0x80))
+    {
+      return true;
+    }
+    shift += 7;
+    if (shift > 28)
+    {
+      return false;
+    }
+  }
+  return false;
+}
+
+// 解码字符串字面量(RFC 7541 5.2)
+static bool decode_string(const uint8_t *&p, const uint8_t *end, std::string &out)
+{
+  if (p >= end)
+  {
+    return false;
+  }
+  bool huffman = *p & 0x80;
+  uint64_t len;
+  if (!decode_int(p, end, 7, len) || len > (uint64_t)(end - p))
+  {
+    return false;
+  }
+
+  out.clear();
+  bool ok = true;
+  if (huffman)
+  {
+    ok = huffman_decode(p, len, out);
+  }
+  else
+  {
+    out.assign(reinterpret_cast<const char *>(p), len);
+  }
+  p += len;
+  return ok;
+}
+
+bool hpack_decoder::lookup(uint64_t index, hpack_header &header) const
+{
+  if (index == 0)
+  {
+    return false;
+  }
+  if (index <= STATIC_TABLE_SIZE)
+  {
+    header = STATIC_TABLE[index - 1];
+    return true;
+  }
+  index -= STATIC_TABLE_SIZE + 1;
+  if (index >= m_dynamic.size())
+  {
+    return false;
+  }
+  header = m_dynamic[index];
+  return true;
+}
+
+void hpack_decoder::evict(size_t max_size)
+{
+  while (m_size > max_size && !m_dynamic.empty())
+  {
+    m_size -= m_dynamic.back().name.size() + m_dynamic.back().value.size() + 32;
+    m_dynamic.pop_back();
+  }
+}
+
+void hpack_decoder::add(const hpack_header &header)
+{
+  size_t entry_size = header.name.size() + header.value.size() + 32;
+  // 比整个表还大的条目会清空动态表，且自身不被加入
+  evict(entry_size > m_max_size ? 0 : m_max_size - entry_size);
+  if (entry_size <= m_max_size)
+  {
+    m_dynamic.push_front(header);
+    m_size += entry_size;
+  }
+}
+
+bool hpack_decoder::decode(const uint8_t *data, size_t len, header_list &headers)
+{
+  const uint8_t *p = data;
+  const uint8_t *end = data + len;
+  size_t list_size = 0;
+
+  while (p < end)
+  {
+    uint8_t b = *p;
+    uint64_t index;
+    hpack_header header;
+
+    if (b & 0x80)
+    {
+      // 索引头部字段
+      if (!decode_int(p, end, 7, index) || !lookup(index, header))
+      {
+        return false;
+      }
+    }
+    else if ((b & 0xe0) == 0x20)
+    {
+      // 动态表大小更新，不能超过我们在SETTINGS中声明的大小
+      if (!decode_int(p, end, 5, index) || index > DEFAULT_TABLE_SIZE)
+      {
+        return false;
+      }
+      m_max_size = index;
+      evict(m_max_size);
+      continue;
+    }
+    else
+    {
+      // 字面量头部字段：01为加入动态表，0000为不加入，0001为永不加入
+      bool indexing = (b & 0xc0) == 0x40;
+      if (!decode_int(p, end, indexing ? 6 : 4, index))
+      {
+        return false;
+      }
+      if (index == 0)
+      {
+        if (!decode_string(p, end, header.name))
+        {
+          return false;
+        }
+      }
+      else if (!lookup(index, header))
+      {
+        return false;
+      }
+      if (!decode_string(p, end, header.value))
+      {
+        return false;
+      }
+      if (indexing)
+      {
+        add(header);
+      }
+    }
+
+    list_size += header.name.size() + header.value.size() + 32;
+    if (list_size > MAX_HEADER_LIST_SIZE)
+    {
+      return false;
+    }
+    headers.push_back(std::move(header));
+  }
+  return true;
+}
+
+// 编码带前缀的整数，first为第一个字节中前缀之外的标志位
+static void encode_int(uint64_t value, int prefix_bits, uint8_t first, std::string &out)
+{
+  uint64_t max_prefix = (1u << prefix_bits) - 1;
+  if (value < max_prefix)
+  {
+    out.push_back(static_cast<char>(first | value));
+    return;
+  }
+  out.push_back(static_cast<char>(first | max_prefix));
+  value -= max_prefix;
+  while (value >= 0x80)
+  {
+    out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<char>(value));
+}
+
+// 不使用霍夫曼编码的字符串字面量
+static void encode_string(std::string_view s, std::string &out)
+{
+  encode_int(s.size(), 7, 0, out);
+  out.append(s);
+}
+
+void hpack_encoder::encode_status(int status, std::string &out)
+{
+  // 静态表中的:status条目，下标8开始
+  static const int indexed[] = {200, 204, 206, 304, 400, 404, 500};
+  for (size_t i = 0; i < sizeof(indexed) / sizeof(indexed[0]); i++)
+  {
+    if (indexed[i] == status)
+    {
+      encode_int(8 + i, 7, 0x80, out);
+      return;
+    }
+  }
+  // 不加入动态表的字面量，名字使用静态表下标8
+  encode_int(8, 4, 0x00, out);
+  encode_string(std::to_string(status), out);
+}
+
+void hpack_encoder::encode_header(std::string_view name, std::string_view value, std::string &out)
+{
+  // 在静态表中查找名字，找到时只发送下标
+  for (size_t i = 0; i < STATIC_TABLE_SIZE; i++)
+  {
+    if (name == STATIC_TABLE[i].name)
+    {
+      encode_int(i + 1, 4, 0x00, out);
+      encode_string(value, out);
+      return;
+    }
+  }
+  out.push_back(0x00);
+  encode_string(name, out);
+  encode_string(value, out);
+}
@@ -0,0 +1,56 @@
+#ifndef HPACK_H
+#define HPACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+
+// HTTP/2头部压缩(RFC 7541)
+
+struct hpack_header
+{
+  std::string name;
+  std::string value;
+};
+
+typedef std::vector<hpack_header> header_list;
+
+// 头部块解码器，每个HTTP/2连接一个，维护对端编码器对应的动态表
+class hpack_decoder
+{
+public:
+  static const size_t DEFAULT_TABLE_SIZE = 4096; // SETTINGS_HEADER_TABLE_SIZE的默认值
+
+  hpack_decoder() : m_size(0), m_max_size(DEFAULT_TABLE_SIZE) {}
+
+  // 解码一个完整的头部块，失败表示COMPRESSION_ERROR，连接必须关闭
+  bool decode(const uint8_t *data, size_t len, header_list &headers);
+
+private:
+  bool lookup(uint64_t index, hpack_header &header) const;
+  void add(const hpack_header &header);
+  void evict(size_t max_size);
+
+  std::deque<hpack_header> m_dynamic; // 最新的条目在前面
+  size_t m_size;                      // 动态表当前大小，每个条目按名字+值+32计算
+  size_t m_max_size;                  // 动态表当前的大小上限
+};
+
+// 头部块编码器，只使用静态表索引和不索引的字面量，不维护动态表，
+// 因此多个流的响应可以按任意顺序编码
+class hpack_encoder
+{
+public:
+  // 编码:status伪头部
+  static void encode_status(int status, std::string &out);
+  // 编码一个普通头部，name必须是小写
+  static void encode_header(std::string_view name, std::string_view value, std::string &out);
+};
+
+// 霍夫曼解码，编码不合法时返回false
+bool huffman_decode(const uint8_t *data, size_t len, std::string &out);
+
+#endif
@@ -0,0 +1,748 @@
+#include "http2.h"
+#include <string.h>
+#include <algorithm>
+
+// 帧类型
+enum FRAME_TYPE
+{
+  FRAME_DATA = 0x0,
+  FRAME_HEADERS = 0x1,
+  FRAME_PRIORITY = 0x2,
+  FRAME_RST_STREAM = 0x3,
+  FRAME_SETTINGS = 0x4,
+  FRAME_PUSH_PROMISE = 0x5,
+  FRAME_PING = 0x6,
+  FRAME_GOAWAY = 0x7,
+  FRAME_WINDOW_UPDATE = 0x8,
+  FRAME_CONTINUATION = 0x9
+};
+
+// 帧标志位
+enum FRAME_FLAG
+{
+  FLAG_END_STREAM = 0x1,
+  FLAG_ACK = 0x1,
+  FLAG_END_HEADERS = 0x4,
+  FLAG_PADDED = 0x8,
+  FLAG_PRIORITY = 0x20
+};
+
+// 错误码
+enum H2_ERROR
+{
+  H2_NO_ERROR = 0x0,
+  H2_PROTOCOL_ERROR = 0x1,
+  H2_INTERNAL_ERROR = 0x2,
+  H2_FLOW_CONTROL_ERROR = 0x3,
+  H2_STREAM_CLOSED = 0x5,
+  H2_FRAME_SIZE_ERROR = 0x6,
+  H2_REFUSED_STREAM = 0x7,
+  H2_CANCEL = 0x8,
+  H2_COMPRESSION_ERROR = 0x9,
+  H2_ENHANCE_YOUR_CALM = 0xb
+};
+
+// SETTINGS参数
+enum SETTINGS_ID
+{
+  SETTINGS_HEADER_TABLE_SIZE = 0x1,
+  SETTINGS_ENABLE_PUSH = 0x2,
+  SETTINGS_MAX_CONCURRENT_STREAMS = 0x3,
+  SETTINGS_INITIAL_WINDOW_SIZE = 0x4,
+  SETTINGS_MAX_FRAME_SIZE = 0x5,
+  SETTINGS_MAX_HEADER_LIST_SIZE = 0x6
+};
+
+static const int64_t DEFAULT_WINDOW = 65535;
+static const int64_t MAX_WINDOW = 0x7fffffff;
+
+static uint32_t read_u32(const uint8_t *p)
+{
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void put_u32(char *p, uint32_t v)
+{
+  p[0] = static_cast<char>(v >> 24);
+  p[1] = static_cast<char>(v >> 16);
+  p[2] = static_cast<char>(v >> 8);
+  p[3] = static_cast<char>(v);
+}
+
+// 写入9字节的帧头
+static void write_frame_header(response_buffer &out, uint32_t len, uint8_t type, uint8_t flags, uint32_t stream_id)
+{
+  char h[9];
+  h[0] = static_cast<char>(len >> 16);
+  h[1] = static_cast<char>(len >> 8);
+  h[2] = static_cast<char>(len);
+  h[3] = static_cast<char>(type);
+  h[4] = static_cast<char>(flags);
+  put_u32(h + 5, stream_id & 0x7fffffff);
+  out.append(std::string_view(h, 9));
+}
+
+static void write_window_update(response_buffer &out, uint32_t stream_id, uint32_t increment)
+{
+  char payload[4];
+  put_u32(payload, increment);
+  write_frame_header(out, 4, FRAME_WINDOW_UPDATE, 0, stream_id);
+  out.append(std::string_view(payload, 4));
+}
+
+// base64url解码，用于HTTP2-Settings头部
+static bool base64url_decode(const std::string &in, std::string &out)
+{
+  uint32_t acc = 0;
+  int bits = 0;
+  for (char c : in)
+  {
+    int v;
+    if (c >= 'A' && c <= 'Z')
+      v = c - 'A';
+    else if (c >= 'a' && c <= 'z')
+      v = c - 'a' + 26;
+    else if (c >= '0' && c <= '9')
+      v = c - '0' + 52;
+    else if (c == '-' || c == '+')
+      v = 62;
+    else if (c == '_' || c == '/')
+      v = 63;
+    else if (c == '=')
+      break;
+    else
+      return false;
+
+    acc = (acc << 6) | v;
+    bits += 6;
+    if (bits >= 8)
+    {
+      bits -= 8;
+      out.push_back(static_cast<char>((acc >> bits) & 0xff));
+    }
+  }
+  return true;
+}
+
+// 把HTTP/1.1格式的响应头部转换为HPACK头部块，去掉HTTP/2中禁止的连接相关头部
+static void encode_head(const std::string &head, std::string &block)
+{
+  hpack_encoder::encode_status(atoi(head.c_str() + 9), block);
+
+  size_t pos = head.find("\r\n");
+  pos = pos == std::string::npos ? head.size() : pos + 2;
+  while (pos < head.size())
+  {
+    size_t end = head.find("\r\n", pos);
+    if (end == std::string::npos || end == pos)
+    {
+      break;
+    }
+    size_t colon = head.find(':', pos);
+    if (colon != std::string::npos && colon < end)
+    {
+      std::string name = head.substr(pos, colon - pos);
+      std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+      size_t value_start = head.find_first_not_of(' ', colon + 1);
+      std::string_view value = value_start < end ? std::string_view(head).substr(value_start, end - value_start) : std::string_view();
+      if (name != "connection" && name != "keep-alive" && name != "transfer-encoding" && name != "upgrade")
+      {
+        hpack_encoder::encode_header(name, value, block);
+      }
+    }
+    pos = end + 2;
+  }
+}
+
+http2_session::http2_session()
+    : m_preface_received(false), m_last_stream_id(0), m_current(0),
+      m_header_stream_id(0), m_header_end_stream(false),
+      m_peer_max_frame_size(16384), m_peer_initial_window(DEFAULT_WINDOW), m_send_window(DEFAULT_WINDOW)
+{
+}
+
+void http2_session::start(response_buffer &out)
+{
+  // 服务端的SETTINGS必须是连接上的第一个帧
+  char payload[6];
+  payload[0] = 0;
+  payload[1] = SETTINGS_MAX_CONCURRENT_STREAMS;
+  put_u32(payload + 2, MAX_CONCURRENT_STREAMS);
+  write_frame_header(out, sizeof(payload), FRAME_SETTINGS, 0, 0);
+  out.append(std::string_view(payload, sizeof(payload)));
+}
+
+bool http2_session::start_upgrade(const std::string &settings, response_buffer &out)
+{
+  std::string decoded;
+  if (!base64url_decode(settings, decoded) || decoded.size() % 6 != 0)
+  {
+    return false;
+  }
+
+  // HTTP2-Settings中的设置由101响应隐式确认，不需要发送ACK
+  response_buffer discard;
+  for (size_t i = 0; i < decoded.size(); i += 6)
+  {
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(decoded.data()) + i;
+    if (!apply_setting((p[0] << 8) | p[1], read_u32(p + 2), discard))
+    {
+      return false;
+    }
+  }
+
+  start(out);
+
+  // 升级请求成为流1，请求已经完整接收
+  std::unique_ptr<h2_stream> stream(new h2_stream(1, m_peer_initial_window));
+  stream->end_stream_received = true;
+  m_streams[1] = std::move(stream);
+  m_last_stream_id = 1;
+  return true;
+}
+
+bool http2_session::on_input(const char *data, size_t len, response_buffer &out)
+{
+  m_input.append(data, len);
+  size_t pos = 0;
+
+  if (!m_preface_received)
+  {
+    size_t n = std::min(m_input.size(), HTTP2_PREFACE_LEN);
+    if (memcmp(m_input.data(), HTTP2_PREFACE, n) != 0)
+    {
+      return connection_error(H2_PROTOCOL_ERROR, out);
+    }
+    if (n < HTTP2_PREFACE_LEN)
+    {
+      return true;
+    }
+    m_preface_received = true;
+    pos = HTTP2_PREFACE_LEN;
+  }
+
+  bool ok = true;
+  while (ok && m_input.size() - pos >= 9)
+  {
+    const uint8_t *h = reinterpret_cast<const uint8_t *>(m_input.data()) + pos;
+    uint32_t frame_len = ((uint32_t)h[0] << 16) | ((uint32_t)h[1] << 8) | h[2];
+    if (frame_len > MAX_FRAME_SIZE)
+    {
+      ok = connection_error(H2_FRAME_SIZE_ERROR, out);
+      break;
+    }
+    if (m_input.size() - pos - 9 < frame_len)
+    {
+      break;
+    }
+
+    ok = handle_frame(h[3], h[4], read_u32(h + 5) & 0x7fffffff, h + 9, frame_len, out);
+    pos += 9 + frame_len;
+  }
+  m_input.erase(0, pos);
+
+  flush(out);
+  return ok;
+}
+
+bool http2_session::handle_frame(uint8_t type, uint8_t flags, uint32_t stream_id, const uint8_t *payload, uint32_t len, response_buffer &out)
+{
+  // 头部块未结束时只能收到同一个流的CONTINUATION
+  if (m_header_stream_id != 0 && (type != FRAME_CONTINUATION || stream_id != m_header_stream_id))
+  {
+    return connection_error(H2_PROTOCOL_ERROR, out);
+  }
+
+  switch (type)
+  {
+  case FRAME_DATA:
+    return on_data(flags, stream_id, payload, len, out);
+  case FRAME_HEADERS:
+    return on_headers(flags, stream_id, payload, len, out);
+  case FRAME_CONTINUATION:
+    if (m_header_stream_id == 0)
+    {
+      return connection_error(H2_PROTOCOL_ERROR, out);
+    }
+    m_header_block.append(reinterpret_cast<const char *>(payload), len);
+    if (m_header_block.size() > MAX_HEADER_BLOCK)
+    {
+      return connection_error(H2_ENHANCE_YOUR_CALM, out);
+    }
+    return (flags & FLAG_END_HEADERS) ? finish_headers(out) : true;
+  case FRAME_PRIORITY:
+    // 不实现优先级，只检查格式
+    if (stream_id == 0)
+    {
+      return connection_error(H2_PROTOCOL_ERROR, out);
+    }
+    if (len != 5)
+    {
+      reset_stream(stream_id, H2_FRAME_SIZE_ERROR, out);
+    }
+    return true;
+  case FRAME_RST_STREAM:
+    if (stream_id == 0 || stream_id > m_last_stream_id)
+    {
+      return connection_error(H2_PROTOCOL_ERROR, out);
+    }
+    if (len != 4)
+    {
+      return connection_error(H2_FRAME_SIZE_ERROR, out);
+    }
+    m_streams.erase(stream_id);
+    return true;
+  case FRAME_SETTINGS:
+    if (stream_id != 0)
+    {
+      return connection_error(H2_PROTOCOL_ERROR, out);
+    }
+    return on_settings(flags, payload, len, out);
+  case FRAME_PUSH_PROMISE:
+    // 客户端不能推送
+    return connection_error(H2_PROTOCOL_ERROR, out);
+  case FRAME_PING:
+    if (stream_id != 0)
+    {
+      return connection_error(H2_PROTOCOL_ERROR, out);
+    }
+    if (len != 8)
+    {
+      return connection_error(H2_FRAME_SIZE_ERROR, out);
+    }
+    if (!(flags & FLAG_ACK))
+    {
+      write_frame_header(out, 8, FRAME_PING, FLAG_ACK, 0);
+      out.append(std::string_view(reinterpret_cast<const char *>(payload), 8));
+    }
+    return true;
+  case FRAME_GOAWAY:
+    // 对端不再创建新的流，已有的流继续完成，由对端关闭连接
+    if (stream_id != 0)
+    {
+      return connection_error(H2_PROTOCOL_ERROR, out);
+    }
+    return true;
+  case FRAME_WINDOW_UPDATE:
+    return on_window_update(stream_id, payload, len, out);
+  default:
+    // 忽略未知类型的帧
+    return true;
+  }
+}
+
+bool http2_session::on_headers(uint8_t flags, uint32_t stream_id, const uint8_t *payload, uint32_t len, response_buffer &out)
+{
+  if (stream_id == 0)
+  {
+    return connection_error(H2_PROTOCOL_ERROR, out);
+  }
+
+  // 去掉填充和优先级字段
+  if (flags & FLAG_PADDED)
+  {
+    if (len < 1 || payload[0] >= len)
+    {
+      return connection_error(H2_PROTOCOL_ERROR, out);
+    }
+    len -= 1 + payload[0];
+    payload++;
+  }
+  if (flags & FLAG_PRIORITY)
+  {
+    if (len < 5)
+    {
+      return connection_error(H2_PROTOCOL_ERROR, out);
+    }
+    payload += 5;
+    len -= 5;
+  }
+
+  auto it = m_streams.find(stream_id);
+  if (it == m_streams.end())
+  {
+    // 新的流，客户端发起的流ID必须是奇数且递增
+    if (stream_id % 2 == 0 || stream_id <= m_last_stream_id)
+    {
+      return connection_error(H2_PROTOCOL_ERROR, out);
+    }
+  }
+  else if (it->second->end_stream_received)
+  {
+    return connection_error(H2_STREAM_CLOSED, out);
+  }
+
+  m_header_block.assign(reinterpret_cast<const char *>(payload), len);
+  m_header_stream_id = stream_id;
+  m_header_end_stream = flags & FLAG_END_STREAM;
+  return (flags & FLAG_END_HEADERS) ? finish_headers(out) : true;
+}
+
+// 头部块接收完整，解码并创建流
+bool http2_session::finish_headers(response_buffer &out)
+{
+  uint32_t stream_id = m_header_stream_id;
+  m_header_stream_id = 0;
+
+  // 即使要拒绝这个流也必须解码，保持动态表与对端一致
+  header_list headers;
+  bool decoded = m_decoder.decode(reinterpret_cast<const uint8_t *>(m_header_block.data()), m_header_block.size(), headers);
+  m_header_block.clear();
+  if (!decoded)
+  {
+    return connection_error(H2_COMPRESSION_ERROR, out);
+  }
+
+  auto it = m_streams.find(stream_id);
+  if (it == m_streams.end())
+  {
+    m_last_stream_id = stream_id;
+    if (m_streams.size() >= MAX_CONCURRENT_STREAMS)
+    {
+      reset_stream(stream_id, H2_REFUSED_STREAM, out);
+      return true;
+    }
+    std::unique_ptr<h2_stream> stream(new h2_stream(stream_id, m_peer_initial_window));
+    stream->headers = std::move(headers);
+    it = m_streams.emplace(stream_id, std::move(stream)).first;
+  }
+  // 已存在的流上收到的是尾部头部，不需要处理
+
+  if (m_header_end_stream)
+  {
+    it->second->end_stream_received = true;
+    dispatch(*it->second);
+  }
+  return true;
+}
+
+bool http2_session::on_data(uint8_t flags, uint32_t stream_id, const uint8_t *payload, uint32_t len, response_buffer &out)
+{
+  if (stream_id == 0 || stream_id > m_last_stream_id)
+  {
+    return connection_error(H2_PROTOCOL_ERROR, out);
+  }
+
+  // 收到的数据计入连接窗口，直接归还，请求体的大小由MAX_BODY_SIZE限制
+  if (len > 0)
+  {
+    write_window_update(out, 0, len);
+  }
+
+  auto it = m_streams.find(stream_id);
+  if (it == m_streams.end() || it->second->end_stream_received)
+  {
+    reset_stream(stream_id, H2_STREAM_CLOSED, out);
+    return true;
+  }
+  h2_stream &stream = *it->second;
+
+  uint32_t data_len = len;
+  if (flags & FLAG_PADDED)
+  {
+    if (len < 1 || payload[0] >= len)
+    {
+      return connection_error(H2_PROTOCOL_ERROR, out);
+    }
+    data_len = len - 1 - payload[0];
+    payload++;
+  }
+
+  if (stream.body.size() + data_len > MAX_BODY_SIZE)
+  {
+    reset_stream(stream_id, H2_CANCEL, out);
+    return true;
+  }
+  stream.body.append(reinterpret_cast<const char *>(payload), data_len);
+
+  if (flags & FLAG_END_STREAM)
+  {
+    stream.end_stream_received = true;
+    dispatch(stream);
+  }
+  else if (len > 0)
+  {
+    write_window_update(out, stream_id, len);
+  }
+  return true;
+}
+
+bool http2_session::on_settings(uint8_t flags, const uint8_t *payload, uint32_t len, response_buffer &out)
+{
+  if (flags & FLAG_ACK)
+  {
+    return len == 0 ? true : connection_error(H2_FRAME_SIZE_ERROR, out);
+  }
+  if (len % 6 != 0)
+  {
+    return connection_error(H2_FRAME_SIZE_ERROR, out);
+  }
+
+  for (uint32_t i = 0; i < len; i += 6)
+  {
+    if (!apply_setting((payload[i] << 8) | payload[i + 1], read_u32(payload + i + 2), out))
+    {
+      return false;
+    }
+  }
+
+  write_frame_header(out, 0, FRAME_SETTINGS, FLAG_ACK, 0);
+  return true;
+}
+
+bool http2_session::apply_setting(uint16_t id, uint32_t value, response_buffer &out)
+{
+  switch (id)
+  {
+  case SETTINGS_ENABLE_PUSH:
+    if (value > 1)
+    {
+      return connection_error(H2_PROTOCOL_ERROR, out);
+    }
+    break;
+  case SETTINGS_INITIAL_WINDOW_SIZE:
+  {
+    if (value > MAX_WINDOW)
+    {
+      return connection_error(H2_FLOW_CONTROL_ERROR, out);
+    }
+    // 初始窗口的变化作用于所有已打开的流
+    int64_t delta = (int64_t)value - m_peer_initial_window;
+    m_peer_initial_window = value;
+    for (auto &entry : m_streams)
+    {
+      entry.second->send_window += delta;
+      if (entry.second->send_window > MAX_WINDOW)
+      {
+        return connection_error(H2_FLOW_CONTROL_ERROR, out);
+      }
+    }
+    break;
+  }
+  case SETTINGS_MAX_FRAME_SIZE:
+    if (value < 16384 || value > 16777215)
+    {
+      return connection_error(H2_PROTOCOL_ERROR, out);
+    }
+    m_peer_max_frame_size = value;
+    break;
+  default:
+    // 编码器不使用动态表，也不推送，其余设置不影响发送
+    break;
+  }
+  return true;
+}
+
+bool http2_session::on_window_update(uint32_t stream_id, const uint8_t *payload, uint32_t len, response_buffer &out)
+{
+  if (len != 4)
+  {
+    return connection_error(H2_FRAME_SIZE_ERROR, out);
+  }
+  uint32_t increment = read_u32(payload) & 0x7fffffff;
+
+  if (stream_id == 0)
+  {
+    if (increment == 0)
+    {
+      return connection_error(H2_PROTOCOL_ERROR, out);
+    }
+    m_send_window += increment;
+    if (m_send_window > MAX_WINDOW)
+    {
+      return connection_error(H2_FLOW_CONTROL_ERROR, out);
+    }
+    return true;
+  }
+
+  auto it = m_streams.find(stream_id);
+  if (it == m_streams.end())
+  {
+    // 已关闭的流上的窗口更新直接忽略
+    return stream_id <= m_last_stream_id ? true : connection_error(H2_PROTOCOL_ERROR, out);
+  }
+  if (increment == 0)
+  {
+    reset_stream(stream_id, H2_PROTOCOL_ERROR, out);
+    return true;
+  }
+  it->second->send_window += increment;
+  if (it->second->send_window > MAX_WINDOW)
+  {
+    reset_stream(stream_id, H2_FLOW_CONTROL_ERROR, out);
+  }
+  return true;
+}
+
+// 请求完整后排队，输入处理完后由http_conn依次取出生成响应
+void http2_session::dispatch(h2_stream &stream)
+{
+  m_ready.push_back(stream.id);
+}
+
+h2_stream *http2_session::next_ready()
+{
+  // 排队期间被对端重置的流已经不在m_streams中，直接跳过
+  while (!m_ready.empty())
+  {
+    uint32_t stream_id = m_ready.front();
+    m_ready.pop_front();
+    if (m_streams.count(stream_id))
+    {
+      m_current = stream_id;
+      return m_streams[stream_id].get();
+    }
+  }
+  return nullptr;
+}
+
+h2_stream *http2_session::current()
+{
+  auto it = m_streams.find(m_current);
+  return it == m_streams.end() ? nullptr : it->second.get();
+}
+
+void http2_session::finish_current(const std::string &head, response_buffer &body,
+                                   std::unique_ptr<archive_stream> archive, response_buffer &out)
+{
+  h2_stream *stream = current();
+  if (stream)
+  {
+    stream->body.clear();
+    stream->body.shrink_to_fit();
+  }
+  submit_response(m_current, head, body, std::move(archive), out);
+  m_current = 0;
+  flush(out);
+}
+
+void http2_session::submit_response(uint32_t stream_id, const std::string &head, response_buffer &body,
+                                    std::unique_ptr<archive_stream> archive, response_buffer &out)
+{
+  auto it = m_streams.find(stream_id);
+  if (it == m_streams.end())
+  {
+    return;
+  }
+  h2_stream &stream = *it->second;
+
+  std::string block;
+  encode_head(head, block);
+
+  // 头部块超过对端的最大帧长度时拆分为HEADERS和若干CONTINUATION
+  bool end_stream = body.empty() && !archive;
+  size_t pos = 0;
+  do
+  {
+    size_t n = std::min<size_t>(block.size() - pos, m_peer_max_frame_size);
+    bool last = pos + n == block.size();
+    uint8_t flags = last ? FLAG_END_HEADERS : 0;
+    if (pos == 0 && end_stream)
+    {
+      flags |= FLAG_END_STREAM;
+    }
+    write_frame_header(out, n, pos == 0 ? FRAME_HEADERS : FRAME_CONTINUATION, flags, stream_id);
+    out.append(std::string_view(block).substr(pos, n));
+    pos += n;
+  } while (pos < block.size());
+
+  if (end_stream)
+  {
+    m_streams.erase(it);
+    return;
+  }
+  stream.pending.swap(body);
+  stream.archive = std::move(archive);
+  stream.responding = true;
+}
+
+void http2_session::flush(response_buffer &out)
+{
+  // 轮流为每个流发送一个DATA帧，直到窗口用完或没有待发送的数据
+  bool progress = true;
+  while (progress && m_send_window > 0)
+  {
+    progress = false;
+    for (auto it = m_streams.begin(); it != m_streams.end() && m_send_window > 0;)
+    {
+      h2_stream &stream = *it->second;
+      // 打包下载的流已追加的成员发送完后等待下一批
+      if (!stream.responding || stream.send_window <= 0 || stream.pending.empty())
+      {
+        ++it;
+        continue;
+      }
+
+      int64_t n = std::min<int64_t>({(int64_t)stream.pending.pending_bytes(), stream.send_window,
+                                     m_send_window, (int64_t)m_peer_max_frame_size});
+      bool last = (uint64_t)n == stream.pending.pending_bytes() && !stream.archive;
+      write_frame_header(out, n, FRAME_DATA, last ? FLAG_END_STREAM : 0, stream.id);
+      stream.pending.transfer(out, n);
+      stream.send_window -= n;
+      m_send_window -= n;
+      progress = true;
+
+      if (last)
+      {
+        it = m_streams.erase(it);
+      }
+      else
+      {
+        ++it;
+      }
+    }
+  }
+}
+
+bool http2_session::wants_batch() const
+{
+  if (m_send_window <= 0)
+  {
+    return false;
+  }
+  for (const auto &entry : m_streams)
+  {
+    const h2_stream &stream = *entry.second;
+    if (stream.archive && stream.send_window > 0 && stream.pending.pending_bytes() < ARCHIVE_LOW_WATER)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+// 每次只追加一批，连接上积压的输出较多时不追加，同时打开的文件数和内存占用与归档大小无关
+void http2_session::continue_archives(response_buffer &out)
+{
+  for (auto &entry : m_streams)
+  {
+    h2_stream &stream = *entry.second;
+    if (stream.archive && stream.pending.pending_bytes() < ARCHIVE_LOW_WATER && out.pending_bytes() < ARCHIVE_LOW_WATER &&
+        stream.archive->next(stream.pending))
+    {
+      stream.archive.reset();
+    }
+  }
+  flush(out);
+}
+
+void http2_session::reset_stream(uint32_t stream_id, uint32_t code, response_buffer &out)
+{
+  char payload[4];
+  put_u32(payload, code);
+  write_frame_header(out, 4, FRAME_RST_STREAM, 0, stream_id);
+  out.append(std::string_view(payload, 4));
+  m_streams.erase(stream_id);
+}
+
+bool http2_session::connection_error(uint32_t code, response_buffer &out)
+{
+  // GOAWAY之后连接就会关闭，排队的流不再处理
+  m_ready.clear();
+  char payload[8];
+  put_u32(payload, m_last_stream_id);
+  put_u32(payload + 4, code);
+  write_frame_header(out, 8, FRAME_GOAWAY, 0, 0);
+  out.append(std::string_view(payload, 8));
+  return false;
+}
@@ -0,0 +1,114 @@
+#ifndef HTTP2_H
+#define HTTP2_H
+
+#include <stdint.h>
+#include <string>
+#include <map>
+#include <deque>
+#include <memory>
+#include "hpack.h"
+#include "response_buffer.h"
+#include "archive_stream.h"
+
+// HTTP/2连接前言
+const char HTTP2_PREFACE[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+const size_t HTTP2_PREFACE_LEN = sizeof(HTTP2_PREFACE) - 1;
+
+// HTTP/2上的一个流，对应一个请求和它的响应
+struct h2_stream
+{
+  uint32_t id;
+  bool end_stream_received; // 请求已经完整接收
+  header_list headers;      // 请求头部
+  std::string body;         // 请求体
+  int64_t send_window;      // 流级别的发送窗口
+  response_buffer pending;  // 等待流量控制窗口发送的响应体
+  bool responding;          // 响应已经生成，pending发送完后流结束
+  std::unique_ptr<archive_stream> archive; // 打包下载还没有追加到pending的成员
+
+  h2_stream(uint32_t stream_id, int64_t window)
+      : id(stream_id), end_stream_received(false), send_window(window), responding(false) {}
+};
+
+/*
+    HTTP/2会话(RFC 9113)，每个切换到HTTP/2的连接一个
+    - 负责二进制分帧、HPACK、流量控制和流的多路复用
+    - 请求完整的流按顺序排队，由http_conn取出后按HTTP/1.1相同的逻辑处理(文件系统操作同样交给磁盘I/O线程池)，
+      生成的响应头部转换为HEADERS帧，响应体以零拷贝方式切分为DATA帧
+    - 输出的帧追加到连接的响应构建器中，由主线程统一发送
+    - 打包下载只在提交时追加第一批成员，之后每当连接的输出发送完，由磁盘I/O线程为待发送数据不足的流追加下一批
+*/
+class http2_session
+{
+public:
+  static const uint32_t MAX_CONCURRENT_STREAMS = 100; // 同时打开的流数量上限
+  static const uint32_t MAX_FRAME_SIZE = 16384;       // 接受的最大帧，使用协议默认值
+  static const size_t MAX_HEADER_BLOCK = 64 * 1024;   // 单个头部块的大小上限
+  static const size_t MAX_BODY_SIZE = 10 * 1024 * 1024; // 单个流的请求体大小上限
+  static const uint64_t ARCHIVE_LOW_WATER = 256 * 1024;  // 打包下载的流和连接待发送的数据都低于该值时追加下一批成员
+
+  http2_session();
+
+  // 以prior knowledge方式开始，发送服务端的SETTINGS
+  void start(response_buffer &out);
+
+  // 通过Upgrade: h2c开始，settings为HTTP2-Settings头部的值，升级请求成为已半关闭的流1
+  bool start_upgrade(const std::string &settings, response_buffer &out);
+
+  // 为指定的流提交响应，head为HTTP/1.1格式的响应头部，archive为打包下载还没有追加的成员
+  void submit_response(uint32_t stream_id, const std::string &head, response_buffer &body,
+                       std::unique_ptr<archive_stream> archive, response_buffer &out);
+
+  // 处理收到的字节，返回false表示出现连接错误，GOAWAY已写入out，发送完后需要关闭连接
+  bool on_input(const char *data, size_t len, response_buffer &out);
+
+  // 在流量控制窗口允许的范围内发送等待中的响应体
+  void flush(response_buffer &out);
+
+  // 是否有打包下载的流待发送的数据不足、可以追加下一批
+  bool wants_batch() const;
+  // 为这些流各追加一批成员后发送，会打开文件，只应在磁盘I/O线程中调用
+  void continue_archives(response_buffer &out);
+
+  // 取出下一个请求已完整的流作为当前流，没有时返回nullptr
+  h2_stream *next_ready();
+  // 正在处理的流，处理期间会话不接收输入，流不会被关闭
+  h2_stream *current();
+  // 为当前流提交响应并开始发送
+  void finish_current(const std::string &head, response_buffer &body,
+                      std::unique_ptr<archive_stream> archive, response_buffer &out);
+
+private:
+  bool handle_frame(uint8_t type, uint8_t flags, uint32_t stream_id, const uint8_t *payload, uint32_t len, response_buffer &out);
+  bool on_headers(uint8_t flags, uint32_t stream_id, const uint8_t *payload, uint32_t len, response_buffer &out);
+  bool on_data(uint8_t flags, uint32_t stream_id, const uint8_t *payload, uint32_t len, response_buffer &out);
+  bool on_settings(uint8_t flags, const uint8_t *payload, uint32_t len, response_buffer &out);
+  bool on_window_update(uint32_t stream_id, const uint8_t *payload, uint32_t len, response_buffer &out);
+  bool apply_setting(uint16_t id, uint32_t value, response_buffer &out);
+  bool finish_headers(response_buffer &out);
+
+  void dispatch(h2_stream &stream);
+  bool connection_error(uint32_t code, response_buffer &out);
+  void reset_stream(uint32_t stream_id, uint32_t code, response_buffer &out);
+
+  hpack_decoder m_decoder;
+  std::string m_input; // 尚未组成完整帧的输入
+  bool m_preface_received;
+
+  std::map<uint32_t, std::unique_ptr<h2_stream>> m_streams;
+  uint32_t m_last_stream_id;
+  std::deque<uint32_t> m_ready; // 请求已完整、等待处理的流
+  uint32_t m_current;           // 正在处理的流
+
+  // 正在接收的头部块，HEADERS之后直到END_HEADERS只能收到同一个流的CONTINUATION
+  std::string m_header_block;
+  uint32_t m_header_stream_id;
+  bool m_header_end_stream;
+
+  // 对端的设置
+  uint32_t m_peer_max_frame_size;
+  int64_t m_peer_initial_window;
+  int64_t m_send_window; // 连接级别的发送窗口
+};
+
+#endif
@@ -1,20 +1,35 @@
 #include "http_conn.h"
 #include "util.h"
-// 定义HTTP响应的一些状态信息
-const char *ok_200_title = "OK";
-const char *error_400_title = "Bad Request";
+// 定义HTTP响应的一些状态信息，状态行见http_headers.h
 const char *error_400_form = "400:Your request has bad syntax or is inherently impossible to satisfy.\n";
-const char *error_403_title = "Forbidden";
 const char *error_403_form = "403:You do not have permission to get file from this server.\n";
-const char *error_404_title = "Not Found";
 const char *error_404_form = "404:The requested file was not found on this server.\n";
-const char *error_500_title = "Internal Error";
+const char *error_413_form = "413:The request body exceeds the size limit of this server.\n";
 const char *error_500_form = "500:There was an unusual problem serving the requested file.\n";
 
+// 生成RFC 7231格式的HTTP日期，如 Sun, 06 Nov 1994 08:49:37 GMT
+static std::string format_http_date(time_t t)
+{
+  char buf[32];
+  struct tm tm;
+  gmtime_r(&t, &tm);
+  size_t len = strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+  return std::string(buf, len);
+}
+
 // 所有的客户数
 int http_conn::m_epollfd = -1;
 // 所有socket上的事件都被注册到同一个epoll内核事件中，所以设置成静态的
 int http_conn::m_user_count = 0;
+// 与nginx的keepalive_requests默认值相同
+int http_conn::m_max_requests = 1000;
+// 大部分静态文件小于16KB
+size_t http_conn::m_pread_max_size = 16 * 1024;
+// 默认使用Proactor模式
+http_conn::CONCURRENCY_MODEL http_conn::m_model = http_conn::PROACTOR;
+// 由main创建
+threadpool<http_conn> *http_conn::m_compute_pool = NULL;
+threadpool<http_conn> *http_conn::m_disk_pool = NULL;
 
 // 网站根目录
 const std::string doc_root = "/home/zen/webserver/resources";
@@ -22,8 +37,74 @@ const std::string doc_root = "/home/zen/webserver/resources";
 // 上传文件目录
 const std::string http_conn::UPLOAD_DIR = "/home/zen/webserver/resources/uploads";
 
+// 解码URL中的%XX，plus_as_space为true时按表单编码把+解码为空格
+static std::string url_decode(const std::string &s, bool plus_as_space)
+{
+  std::string out;
+  out.reserve(s.size());
+  for (size_t i = 0; i < s.size(); ++i)
+  {
+    if (s[i] == '+' && plus_as_space)
+    {
+      out += ' ';
+    }
+    else if (s[i] == '%' && i + 2 < s.size() && isxdigit((unsigned char)s[i + 1]) && isxdigit((unsigned char)s[i + 2]))
+    {
+      out += (char)strtol(s.substr(i + 1, 2).c_str(), NULL, 16);
+      i += 2;
+    }
+    else
+    {
+      out += s[i];
+    }
+  }
+  return out;
+}
+
+// 上传目录中的文件名不能为空、不能包含/，也不能以.开头(描述文件、临时文件和..)
+static bool valid_upload_name(const std::string &name)
+{
+  return !name.empty() && name[0] != '.' && name.find('/') == std::string::npos && name.find('\0') == std::string::npos;
+}
+
+// 把s作为JSON字符串追加到out，非ASCII字节按原样输出(文件名和描述都是UTF-8)
+static void append_json_string(std::string &out, const std::string &s)
+{
+  out += '"';
+  for (unsigned char c : s)
+  {
+    if (c == '"' || c == '\\')
+    {
+      out += '\\';
+      out += c;
+    }
+    else if (c < 0x20)
+    {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", c);
+      out += buf;
+    }
+    else
+    {
+      out += c;
+    }
+  }
+  out += '"';
+}
+
+// 从/uploads/<name>形式的URL中取出解码后的文件名，忽略查询字符串
+static bool parse_upload_url(const std::string &url, std::string &name)
+{
+  if (url.compare(0, 9, "/uploads/") != 0)
+  {
+    return false;
+  }
+  name = url_decode(url.substr(9, url.find('?') == std::string::npos ? std::string::npos : url.find('?') - 9), false);
+  return valid_upload_name(name);
+}
+
 // 初始化连接
-void http_conn::init(int sockfd, const sockaddr_in &addr)
+void http_conn::init(int sockfd, const sockaddr_in &addr, bool tls)
 {
   m_sockfd = sockfd;
   m_address = addr;
@@ -32,6 +113,13 @@ void http_conn::init(int sockfd, const sockaddr_in &addr)
   int reuse = 1;
   setsockopt(m_sockfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
 
+  // HTTPS连接先完成TLS握手再处理请求
+  m_ssl = tls ? tls_new(m_sockfd) : NULL;
+  m_tls_handshaking = m_ssl != NULL;
+  m_ktls_send = false;
+  m_h2.reset();
+  m_request_count = 0;
+
   // 添加到epoll对象中
   addfd(m_epollfd, m_sockfd, true);
   m_user_count++; // 总用户数+1
@@ -43,30 +131,64 @@ void http_conn::init()
 {
   // 不再需要手动释放文件映射
   m_file_address.reset();
-
-  bytes_to_send = 0;
-  bytes_have_send = 0;
+  m_file_window.reset();
+  m_response.clear();
+  m_listing.reset();
+  m_archive.reset();
+  m_upload.reset();
 
   m_check_state = CHECK_STATE_REQUESTLINE; // 初始化状态为解析请求首行
-  m_linger = false;                        // 默认不保持链接  Connection : keep-alive保持连接
   m_start_line = 0;
   m_checked_idx = 0;
   m_read_idx = 0;
-  m_write_idx = 0;
-  m_method = GET; // 默认请求方式为GET
+  m_request_len = 0;
+  m_phase = PHASE_PARSE;
+  // 读缓冲区只依赖m_read_idx和结束符，不需要整块清零
+  m_read_buf[0] = '\0';
+
+  reset_request();
+}
+
+// HTTP/2的每个流和流水线中的每个请求都复用这些成员，因此与连接的读写状态分开重置
+// 字符串只清空长度并保留容量，下一个请求填充时不需要重新分配内存
+void http_conn::reset_request()
+{
+  m_linger = false; // 由请求行的协议版本决定默认值，Connection头部可以覆盖
+  m_method = GET;   // 默认请求方式为GET
   m_url.clear();
   m_version.clear();
   m_content_length = 0;
   m_host.clear();
+  m_has_content_length = false;
+  m_chunked_body = false;
+  m_chunked.reset();
+  m_expect_continue = false;
+  m_continue_sent = false;
 
   // 初始化文件上传相关成员
   m_content_type.clear();
   m_boundary.clear();
-  m_upload_file_name.clear();
   m_is_upload_request = false;
+  m_body_buffering = false;
+  std::string().swap(m_body_buf); // 释放上传表单占用的内存
+  m_form_body.clear();
+
+  m_upgrade_h2c = false;
+  m_http2_settings.clear();
+
+  m_range.clear();
+  m_if_range.clear();
+  m_if_none_match.clear();
+  m_if_modified_since.clear();
+
+  m_accept_encoding = ENCODING_NONE;
+  m_content_encoding = std::string_view();
+  m_compressible = false;
+  m_body_file.clear();
+  m_encoded_body.reset();
+  m_etag.clear();
+  m_dynamic_body = false;
 
-  bzero(m_read_buf, READ_BUFFER_SIZE);
-  bzero(m_write_buf, READ_BUFFER_SIZE);
   m_real_file.clear();
 }
 
@@ -75,28 +197,152 @@ void http_conn::close_conn()
 {
   if (m_sockfd != -1)
   {
+    if (m_ssl)
+    {
+      // 尽力发送close_notify，非阻塞socket上不等待对方的回应
+      SSL_shutdown(m_ssl);
+      SSL_free(m_ssl);
+      m_ssl = NULL;
+    }
     removefd(m_epollfd, m_sockfd);
     m_sockfd = -1;
     m_user_count--; // 用户数-1
 
     // 智能指针会自动清理资源
     m_file_address.reset();
+    m_file_window.reset();
+    m_response.clear();
+    m_listing.reset();
+    m_archive.reset();
+    m_upload.reset();
+    m_h2.reset();
+  }
+}
+
+// 推进TLS握手，握手未完成时根据OpenSSL的需要重新注册读或写事件
+int http_conn::tls_handshake()
+{
+  int ret = SSL_do_handshake(m_ssl);
+  if (ret == 1)
+  {
+    m_tls_handshaking = false;
+    m_ktls_send = BIO_get_ktls_send(SSL_get_wbio(m_ssl));
+    printf("TLS握手完成: %s %s%s, kTLS发送%s\n", SSL_get_version(m_ssl), SSL_get_cipher_name(m_ssl),
+           SSL_session_reused(m_ssl) ? " (会话恢复)" : "", m_ktls_send ? "已启用" : "未启用");
+    return 1;
+  }
+
+  switch (SSL_get_error(m_ssl, ret))
+  {
+  case SSL_ERROR_WANT_READ:
+    modfd(m_epollfd, m_sockfd, EPOLLIN);
+    return 0;
+  case SSL_ERROR_WANT_WRITE:
+    modfd(m_epollfd, m_sockfd, EPOLLOUT);
+    return 0;
+  default:
+    tls_print_errors("TLS握手失败");
+    return -1;
+  }
+}
+
+// 读取数据，返回值的含义与recv相同
+ssize_t http_conn::recv_some(char *buf, size_t len)
+{
+  if (!m_ssl)
+  {
+    return recv(m_sockfd, buf, len, 0);
+  }
+
+  int ret = SSL_read(m_ssl, buf, len);
+  if (ret > 0)
+  {
+    return ret;
+  }
+  switch (SSL_get_error(m_ssl, ret))
+  {
+  case SSL_ERROR_WANT_READ:
+  case SSL_ERROR_WANT_WRITE:
+    errno = EAGAIN;
+    return -1;
+  case SSL_ERROR_ZERO_RETURN:
+    // 对方发送了close_notify
+    return 0;
+  default:
+    errno = EIO;
+    return -1;
   }
 }
 
+// 发送数据，返回值的含义与writev相同
+ssize_t http_conn::send_iov(const struct iovec *iov, int iov_count)
+{
+  // 明文连接和已启用kTLS的连接直接分散写，由内核完成加密
+  if (!m_ssl || m_ktls_send)
+  {
+    return writev(m_sockfd, iov, iov_count);
+  }
+
+  // 用户态加密，逐块调用SSL_write
+  ssize_t total = 0;
+  for (int i = 0; i < iov_count; i++)
+  {
+    int ret = SSL_write(m_ssl, iov[i].iov_base, iov[i].iov_len);
+    if (ret > 0)
+    {
+      total += ret;
+      if ((size_t)ret < iov[i].iov_len)
+      {
+        break;
+      }
+      continue;
+    }
+
+    if (total > 0)
+    {
+      break;
+    }
+    int err = SSL_get_error(m_ssl, ret);
+    errno = (err == SSL_ERROR_WANT_WRITE || err == SSL_ERROR_WANT_READ) ? EAGAIN : EIO;
+    return -1;
+  }
+  return total;
+}
+
 // 循环读取客户数据，直到无数据可读或者对方关闭连接
 bool http_conn::read()
 {
-  if (m_read_idx >= READ_BUFFER_SIZE)
+  if (m_tls_handshaking)
+  {
+    int ret = tls_handshake();
+    if (ret <= 0)
+    {
+      return ret == 0;
+    }
+  }
+
+  // 正在流式上传或读入上传表单，请求体不经过读缓冲区
+  if (m_upload)
+  {
+    return read_body();
+  }
+  if (m_body_buffering)
+  {
+    return read_form_body();
+  }
+
+  // 保留一个字节存放字符串结束符
+  if (m_read_idx >= READ_BUFFER_SIZE - 1)
   {
     return false;
   }
+
   // 读取到的字节
-  int bytes_read = 0;
+  ssize_t bytes_read = 0;
   while (true)
   {
     // 从m_read_buf + m_read_idx索引开始保存数据，大小是READ_BUFFER_SIZE - m_read_idx
-    bytes_read = recv(m_sockfd, m_read_buf + m_read_idx, READ_BUFFER_SIZE - m_read_idx, 0);
+    bytes_read = recv_some(m_read_buf + m_read_idx, READ_BUFFER_SIZE - 1 - m_read_idx);
     if (bytes_read == -1)
     {
       if (errno == EAGAIN || errno == EWOULDBLOCK)
@@ -112,27 +358,211 @@ bool http_conn::read()
       return false;
     }
     m_read_idx += bytes_read;
+    if (m_read_idx >= READ_BUFFER_SIZE - 1)
+    {
+      break;
+    }
   }
+  m_read_buf[m_read_idx] = '\0';
   printf("读取到了数据:%s\n", m_read_buf);
   return true;
 }
 
-bool http_conn::write()
+// 把请求体直接读入上传缓冲区，最多读到请求体结束，之后的字节留给流水线中的下一个请求
+bool http_conn::read_body()
 {
-  int temp = 0;
+  while (m_upload->space() > 0)
+  {
+    ssize_t bytes_read = recv_some(m_upload->tail(), m_upload->space());
+    if (bytes_read == -1)
+    {
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+      {
+        break;
+      }
+      return false;
+    }
+    else if (bytes_read == 0)
+    {
+      // 请求体没有收完对方就关闭了连接，临时文件随m_upload一起删除
+      return false;
+    }
+    if (!m_chunked)
+    {
+      m_upload->produced(bytes_read);
+      continue;
+    }
 
-  if (bytes_to_send == 0)
+    // 分块编码的原始字节在上传缓冲区中就地解码
+    char *raw = m_upload->tail();
+    size_t consumed = decode_upload(raw, bytes_read);
+    if (m_chunked->status() == chunked_decoder::DONE)
+    {
+      keep_pipelined(raw + consumed, bytes_read - consumed);
+    }
+  }
+  return true;
+}
+
+// 最后一块之后的字节属于流水线中的下一个请求，放回读缓冲区；放不下时响应后关闭连接
+void http_conn::keep_pipelined(const char *data, size_t len)
+{
+  if (m_read_idx + len < READ_BUFFER_SIZE)
   {
-    // 将要发送的字节为0，这一次响应结束。
-    modfd(m_epollfd, m_sockfd, EPOLLIN);
-    init();
-    return true;
+    memcpy(m_read_buf + m_read_idx, data, len);
+    m_read_idx += len;
+    m_read_buf[m_read_idx] = '\0';
   }
+  else
+  {
+    m_linger = false;
+  }
+}
 
+// 上传表单的请求体读入m_body_buf，有Content-Length时不会读过请求体的末尾
+bool http_conn::read_form_body()
+{
+  char buf[16384];
+  while (form_body_status() == NO_REQUEST)
+  {
+    size_t want = m_chunked ? sizeof(buf) : std::min<uint64_t>(sizeof(buf), m_content_length - m_body_buf.size());
+    ssize_t bytes_read = recv_some(buf, want);
+    if (bytes_read == -1)
+    {
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+      {
+        break;
+      }
+      return false;
+    }
+    else if (bytes_read == 0)
+    {
+      return false;
+    }
+    size_t consumed = append_form_body(buf, bytes_read);
+    if (m_chunked && m_chunked->status() == chunked_decoder::DONE)
+    {
+      keep_pipelined(buf + consumed, bytes_read - consumed);
+    }
+  }
+  return true;
+}
+
+size_t http_conn::append_form_body(const char *data, size_t len)
+{
+  if (!m_chunked)
+  {
+    size_t n = std::min<uint64_t>(len, m_content_length - m_body_buf.size());
+    m_body_buf.append(data, n);
+    return n;
+  }
+
+  // 解码后的数据不会比原始字节长
+  size_t old = m_body_buf.size();
+  size_t consumed, produced;
+  m_body_buf.resize(old + len);
+  m_chunked->decode(data, len, &m_body_buf[old], len, consumed, produced);
+  m_body_buf.resize(old + produced);
+  if (m_chunked->status() == chunked_decoder::DONE)
+  {
+    m_content_length = m_body_buf.size();
+  }
+  return consumed;
+}
+
+http_conn::HTTP_CODE http_conn::form_body_status() const
+{
+  if (!m_chunked)
+  {
+    return (int64_t)m_body_buf.size() == m_content_length ? GET_REQUEST : NO_REQUEST;
+  }
+  switch (m_chunked->status())
+  {
+  case chunked_decoder::DONE:
+    return GET_REQUEST;
+  case chunked_decoder::BAD:
+    return BAD_REQUEST;
+  case chunked_decoder::TOO_LARGE:
+    return PAYLOAD_TOO_LARGE;
+  default:
+    return NO_REQUEST;
+  }
+}
+
+// 解码分块编码的原始字节，数据部分追加到上传缓冲区，data可以就是上传缓冲区的空闲部分
+// 请求体结束或解码出错时结束上传缓冲区的接收，由continue_upload提交文件或返回错误
+size_t http_conn::decode_upload(const char *data, size_t len)
+{
+  size_t consumed, produced;
+  m_chunked->decode(data, len, m_upload->tail(), m_upload->space(), consumed, produced);
+  m_upload->produced(produced);
+  if (m_chunked->status() != chunked_decoder::MORE)
+  {
+    m_upload->finish();
+  }
+  return consumed;
+}
+
+bool http_conn::write()
+{
+  if (m_tls_handshaking)
+  {
+    // 握手过程中等待可写事件，握手完成后开始等待请求
+    int ret = tls_handshake();
+    if (ret == 1)
+    {
+      modfd(m_epollfd, m_sockfd, EPOLLIN);
+    }
+    return ret >= 0;
+  }
+
+  struct iovec iov[MAX_IOV];
   while (1)
   {
-    // 分散写
-    temp = writev(m_sockfd, m_iv, m_iv_count);
+    if (m_response.empty())
+    {
+      // 文件列表或打包下载的上一批已发送完，由线程池生成下一批，生成后重新注册EPOLLOUT
+      if ((m_listing || m_archive || (m_h2 && m_h2->wants_batch())) && schedule_batch())
+      {
+        return true;
+      }
+      if (m_response.empty())
+      {
+        // 没有数据要发送了，排队的响应都已发出。读缓冲区中可能还有未收完的下一个请求，不能重置
+        // TLS层中还有已解密的数据时不会再触发EPOLLIN(例如HTTP/2的WINDOW_UPDATE发出后，对端的数据已全部读进TLS层)，
+        // 直接当作读事件交给工作线程
+        if (m_ssl && SSL_pending(m_ssl) > 0)
+        {
+          if (m_model == REACTOR)
+          {
+            m_io_event = EVENT_READ;
+          }
+          else if (!read())
+          {
+            return false;
+          }
+          if (!m_compute_pool->append(this))
+          {
+            // 计算线程池队列已满时直接在当前线程处理，重新注册EPOLLIN会一直等不到事件
+            process();
+          }
+          return true;
+        }
+        modfd(m_epollfd, m_sockfd, EPOLLIN);
+        return true;
+      }
+    }
+
+    // 分散写，直接使用响应构建器生成的iovec数组
+    int iov_count = m_response.fill_iovec(iov, MAX_IOV);
+    if (iov_count == 0)
+    {
+      // 响应不为空却生成不了iovec，说明文件窗口映射失败，按I/O错误关闭连接，否则会一直空转
+      m_file_address.reset();
+      m_file_window.reset();
+      return false;
+    }
+    ssize_t temp = send_iov(iov, iov_count);
     if (temp <= -1)
     {
       // 如果TCP写缓冲没有空间，则等待下一轮EPOLLOUT事件，虽然在此期间，
@@ -144,66 +574,466 @@ bool http_conn::write()
       }
       // 智能指针会自动释放资源
       m_file_address.reset();
+      m_file_window.reset();
       return false;
     }
-    bytes_to_send -= temp;
-    bytes_have_send += temp;
+    m_response.consume(temp);
 
-    if (bytes_have_send >= m_iv[0].iov_len)
+    if (m_response.close_requested())
     {
-      m_iv[0].iov_len = 0;
-      m_iv[1].iov_base = m_file_address.get() + (bytes_have_send - m_write_idx);
-      m_iv[1].iov_len = bytes_to_send;
+      // 已发送完一个要求关闭连接的响应
+      m_file_address.reset();
+      m_file_window.reset();
+      return false;
     }
-    else
+  }
+}
+
+// 把生成下一批的任务交给磁盘I/O线程池，没有或队列已满时交给计算线程池
+// 都提交失败时直接在当前线程生成，返回false表示调用者应继续发送
+bool http_conn::schedule_batch()
+{
+  m_phase = PHASE_BATCH;
+  if ((m_disk_pool && m_disk_pool->append(this)) || m_compute_pool->append(this))
+  {
+    return true;
+  }
+  m_phase = PHASE_PARSE;
+  return continue_batch() == 0;
+}
+
+int http_conn::continue_batch()
+{
+  if (m_h2)
+  {
+    // HTTP/2连接上的打包下载由会话为各个流追加下一批
+    m_h2->continue_archives(m_response);
+    return m_response.empty() ? EPOLLIN : EPOLLOUT;
+  }
+  return m_archive ? continue_archive() : continue_listing();
+}
+
+// 生成文件列表的下一批作为一个chunk
+int http_conn::continue_listing()
+{
+  std::string data;
+  bool done = m_listing->next(data);
+  add_chunk(data);
+  if (!done)
+  {
+    return EPOLLOUT;
+  }
+
+  add_response(http_headers::LAST_CHUNK);
+  m_listing.reset();
+  return finish_batch();
+}
+
+// 打开下一批成员，头部和文件内容追加到响应中，响应的长度已经由Content-Length确定
+int http_conn::continue_archive()
+{
+  if (!m_archive->next(m_response))
+  {
+    return EPOLLOUT;
+  }
+  m_archive.reset();
+  return finish_batch();
+}
+
+// 响应体结束后继续处理流水线中后面的请求
+int http_conn::finish_batch()
+{
+  m_response.end_response(m_linger);
+  if (!m_linger)
+  {
+    return EPOLLOUT;
+  }
+  consume_request();
+  return process_request();
+}
+
+// 由线程池中的工作线程调用，这是处理http请求的入口函数
+void http_conn::process()
+{
+  if (m_phase == PHASE_DISK)
+  {
+    // 磁盘I/O线程：执行文件系统操作，然后把连接交回计算线程池生成响应
+    m_disk_ret = handle_request();
+    m_phase = PHASE_RESUME;
+    if (m_compute_pool->append(this))
     {
-      m_iv[0].iov_base = m_write_buf + bytes_have_send;
-      m_iv[0].iov_len = m_iv[0].iov_len - temp;
+      return;
     }
+    // 计算线程池队列已满，直接在当前线程继续
+  }
 
-    if (bytes_to_send <= 0)
+  if (m_phase == PHASE_BATCH)
+  {
+    m_phase = PHASE_PARSE;
+    dispatch(continue_batch());
+    return;
+  }
+
+  // Reactor模式，工作线程自己完成读写；从磁盘I/O线程回来的请求数据已经读入
+  if (m_model == REACTOR && m_phase != PHASE_RESUME)
+  {
+    if (m_io_event == EVENT_WRITE)
     {
-      // 没有数据要发送了
-      m_file_address.reset();
+      if (!write())
+      {
+        close_conn();
+      }
+      return;
+    }
 
-      modfd(m_epollfd, m_sockfd, EPOLLIN);
+    if (!read())
+    {
+      close_conn();
+      return;
+    }
+    if (handshaking())
+    {
+      // TLS握手尚未完成，tls_handshake已经重新注册了需要的事件
+      return;
+    }
+  }
+
+  dispatch(process_request());
+}
 
-      if (m_linger)
+// 根据process_request的结果等待事件，Reactor模式下有响应时直接发送
+void http_conn::dispatch(int event)
+{
+  // TLS层已经解密、但读缓冲区放不下的数据不会再触发EPOLLIN，直接继续读取处理
+  while (event == EPOLLIN && m_ssl && SSL_pending(m_ssl) > 0)
+  {
+    if (!read())
+    {
+      close_conn();
+      return;
+    }
+    event = process_request();
+  }
+
+  if (event == EPOLLOUT && m_model == REACTOR)
+  {
+    // 直接在当前线程发送响应，省去一次事件循环的往返
+    if (!write())
+    {
+      close_conn();
+    }
+  }
+  else if (event)
+  {
+    // Proactor模式下由主线程发送
+    modfd(m_epollfd, m_sockfd, event);
+  }
+}
+
+int http_conn::process_request()
+{
+  // 已切换到HTTP/2，或者客户端直接以连接前言开始(prior knowledge或ALPN协商的h2)
+  if (m_h2 || is_h2_preface())
+  {
+    return process_h2();
+  }
+
+  // 从磁盘I/O线程回来，继续为当前请求生成响应
+  HTTP_CODE read_ret = NO_REQUEST;
+  if (m_phase == PHASE_RESUME)
+  {
+    m_phase = PHASE_PARSE;
+    read_ret = static_cast<HTTP_CODE>(m_disk_ret);
+  }
+
+  // 流水线：依次处理读缓冲区中所有完整的请求，响应按顺序排队，由write()合并到同一次writev中发送
+  while (true)
+  {
+    if (read_ret == NO_REQUEST)
+    {
+      // 解析HTTP请求；正在流式上传时，读入的请求体交给磁盘I/O线程写入文件
+      read_ret = m_upload ? (m_upload->ready() ? GET_REQUEST : NO_REQUEST) : process_read();
+      if (read_ret == NO_REQUEST)
       {
-        init();
-        return true;
+        break;
       }
-      else
+
+      if (read_ret == GET_REQUEST)
       {
-        return false;
+        // 请求完整，文件系统操作交给磁盘I/O线程池，当前线程返回继续处理其他连接
+        // 阶段必须在提交之前设置，磁盘I/O线程可能立即开始执行
+        m_phase = PHASE_DISK;
+        if (m_disk_pool && m_disk_pool->append(this))
+        {
+          return 0;
+        }
+        m_phase = PHASE_PARSE;
+        read_ret = handle_request();
       }
     }
+
+    // 上传的请求体还没有收完，继续读取
+    if (read_ret == NO_REQUEST)
+    {
+      break;
+    }
+
+    // 明文连接上的Upgrade: h2c，响应101后以HTTP/2在流1上返回这个请求的响应
+    if (m_upgrade_h2c && process_upgrade(read_ret))
+    {
+      return serve_streams();
+    }
+
+    // 请求有语法错误时无法确定它在缓冲区中的边界，请求体过大时不再接收请求体，都在响应后关闭连接
+    if (read_ret == BAD_REQUEST || read_ret == PAYLOAD_TOO_LARGE)
+    {
+      m_linger = false;
+    }
+
+    // 达到单个连接的请求数上限，这个响应之后关闭连接
+    if (m_max_requests > 0 && ++m_request_count >= m_max_requests)
+    {
+      m_linger = false;
+    }
+
+    // 生成响应
+    bool write_ret = process_write(read_ret);
+    m_file_address.reset();
+    m_file_window.reset();
+    if (!write_ret)
+    {
+      close_conn();
+      return 0;
+    }
+
+    // 文件列表或打包下载还在分批发送，后面的请求等它发送完再处理
+    if (m_listing || m_archive)
+    {
+      return EPOLLOUT;
+    }
+
+    // 该响应发送完后连接就会关闭，不再处理后面的请求
+    if (!m_linger)
+    {
+      break;
+    }
+    consume_request();
+    read_ret = NO_REQUEST;
   }
+
+  return m_response.empty() ? EPOLLIN : EPOLLOUT;
 }
 
-// 由线程池中的工作线程调用，这是处理http请求的入口函数
-void http_conn::process()
+void http_conn::consume_request()
 {
-  // 解析HTTP请求
-  HTTP_CODE read_ret = process_read();
-  if (read_ret == NO_REQUEST)
+  int next = (int)m_request_len; // 完整的请求一定在读缓冲区内
+  // 请求之间多余的空行直接跳过
+  while (next + 1 < m_read_idx && m_read_buf[next] == '\r' && m_read_buf[next + 1] == '\n')
   {
-    modfd(m_epollfd, m_sockfd, EPOLLIN);
-    return;
+    next += 2;
+  }
+  m_read_idx -= next;
+  memmove(m_read_buf, m_read_buf + next, m_read_idx);
+  m_read_buf[m_read_idx] = '\0';
+  m_request_len = 0;
+
+  reset_request();
+}
+
+// 读缓冲区是否以HTTP/2连接前言开始，前言只收到一部分时也认为是
+bool http_conn::is_h2_preface() const
+{
+  size_t n = std::min((size_t)m_read_idx, HTTP2_PREFACE_LEN);
+  return n >= 3 && memcmp(m_read_buf, HTTP2_PREFACE, n) == 0;
+}
+
+// 把读到的字节交给HTTP/2会话，生成的帧追加到m_response
+int http_conn::process_h2()
+{
+  // 从磁盘I/O线程回来，为当前流生成响应；读到的字节在提交之前已经交给会话
+  if (m_phase == PHASE_RESUME)
+  {
+    m_phase = PHASE_PARSE;
+    finish_stream(static_cast<HTTP_CODE>(m_disk_ret));
+    return serve_streams();
+  }
+
+  if (!m_h2)
+  {
+    m_h2.reset(new http2_session());
+    m_h2->start(m_response);
+  }
+
+  if (!m_h2->on_input(m_read_buf, m_read_idx, m_response))
+  {
+    // 连接错误，GOAWAY发送完后关闭连接
+    m_response.end_response(false);
+  }
+  m_read_idx = 0;
+
+  return serve_streams();
+}
+
+// 依次处理请求已完整的流，与HTTP/1.1相同，文件系统操作交给磁盘I/O线程池
+int http_conn::serve_streams()
+{
+  while (h2_stream *stream = m_h2->next_ready())
+  {
+    m_phase = PHASE_DISK;
+    if (m_disk_pool && m_disk_pool->append(this))
+    {
+      return 0;
+    }
+    m_phase = PHASE_PARSE;
+    finish_stream(serve_stream(stream->headers, stream->body));
+  }
+  return m_response.empty() ? EPOLLIN : EPOLLOUT;
+}
+
+// 处理h2c升级，HTTP/1.0请求、HTTP2-Settings不合法或请求带有请求体时不升级，按HTTP/1.x正常响应
+bool http_conn::process_upgrade(HTTP_CODE ret)
+{
+  if (m_ssl || m_method != GET || m_version != "1.1" || m_content_length != 0 || m_http2_settings.empty())
+  {
+    return false;
+  }
+
+  std::unique_ptr<http2_session> session(new http2_session());
+  response_buffer frames;
+  if (!session->start_upgrade(m_http2_settings, frames))
+  {
+    return false;
+  }
+  printf("连接升级到HTTP/2\n");
+
+  // 101响应之后紧跟服务端的SETTINGS，然后是流1的响应
+  m_h2 = std::move(session);
+  m_response.append(http_headers::STATUS_101_H2C);
+  frames.transfer(m_response, frames.pending_bytes());
+
+  std::string head;
+  response_buffer body;
+  build_stream_response(ret, head, body);
+  m_h2->submit_response(1, head, body, std::move(m_archive), m_response);
+
+  // 升级请求之后的字节是客户端的连接前言和后续的帧
+  if (!m_h2->on_input(m_read_buf + m_request_len, m_read_idx - m_request_len, m_response))
+  {
+    m_response.end_response(false);
+  }
+  m_read_idx = 0;
+  return true;
+}
+
+// 处理HTTP/2流上的一个请求，伪头部映射到请求行，其余头部与HTTP/1.1共用同一套处理逻辑
+http_conn::HTTP_CODE http_conn::serve_stream(const header_list &headers, const std::string &body)
+{
+  reset_request();
+  m_linger = true;
+
+  HTTP_CODE ret = GET_REQUEST;
+  for (const hpack_header &header : headers)
+  {
+    if (header.name == ":method")
+    {
+      if (!parse_method(header.value))
+      {
+        ret = BAD_REQUEST;
+      }
+    }
+    else if (header.name == ":path")
+    {
+      m_url = header.value;
+    }
+    else if (header.name == ":authority")
+    {
+      m_host = header.value;
+    }
+    else if (header.name[0] != ':' && header.name != "content-length")
+    {
+      on_header(header.name, header.value);
+    }
+  }
+  if (m_url.empty() || m_url[0] != '/')
+  {
+    ret = BAD_REQUEST;
   }
 
-  // 生成响应
-  bool write_ret = process_write(read_ret);
-  if (!write_ret)
+  // 请求体的长度以实际收到的DATA帧为准
+  m_content_length = body.size();
+  if (ret != BAD_REQUEST && m_method == PUT)
+  {
+    // 请求体已经完整收到，同样分批经过上传缓冲区写入文件
+    ret = start_upload();
+    size_t done = 0;
+    while (ret == GET_REQUEST || ret == NO_REQUEST)
+    {
+      done += m_upload->append(body.data() + done, body.size() - done);
+      ret = continue_upload();
+    }
+  }
+  else
   {
-    close_conn();
+    if (ret != BAD_REQUEST && !body.empty())
+    {
+      ret = handle_body(body);
+    }
+    // 与process_read相同，请求体处理完后统一由do_request确定响应内容
+    if (ret == GET_REQUEST)
+    {
+      ret = do_request();
+    }
   }
-  modfd(m_epollfd, m_sockfd, EPOLLOUT);
+  return ret;
+}
+
+// 为当前流生成响应，交给HTTP/2会话分帧
+void http_conn::finish_stream(HTTP_CODE ret)
+{
+  std::string head;
+  response_buffer body;
+  build_stream_response(ret, head, body);
+  m_h2->finish_current(head, body, std::move(m_archive), m_response);
+}
+
+// 借用m_response生成HTTP/1.1格式的响应，再拆分为头部文本和响应体
+void http_conn::build_stream_response(HTTP_CODE ret, std::string &head, response_buffer &resp_body)
+{
+  // m_response中可能还有待发送的帧，先换出来
+  response_buffer saved;
+  m_response.swap(saved);
+  process_write(ret);
+
+  // 头部都是拷贝进内存块的小块数据，按空行切分
+  struct iovec iov[MAX_IOV];
+  int iov_count = m_response.fill_iovec(iov, MAX_IOV);
+  for (int i = 0; i < iov_count; i++)
+  {
+    head.append(static_cast<const char *>(iov[i].iov_base), iov[i].iov_len);
+    size_t end = head.find("\r\n\r\n");
+    if (end != std::string::npos)
+    {
+      head.resize(end + 4);
+      break;
+    }
+  }
+  m_response.consume(head.size());
+
+  resp_body.swap(m_response);
+  m_response.swap(saved);
+  m_file_address.reset();
+  m_file_window.reset();
 }
 
 // 主状态机，解析请求 - 使用正则表达式
 http_conn::HTTP_CODE http_conn::process_read()
 {
+  // 上传表单的请求体正在读入m_body_buf，头部已经解析过
+  if (m_body_buffering)
+  {
+    return form_body_status();
+  }
+
   // 初始化缓冲区末尾，确保字符串正确终止
   m_read_buf[m_read_idx] = '\0';
 
@@ -225,40 +1055,158 @@ http_conn::HTTP_CODE http_conn::process_read()
 
   // 解析请求头
   ret = parse_headers(request);
-  if (ret == BAD_REQUEST)
+  if (ret == BAD_REQUEST || m_content_length < 0)
   {
     return BAD_REQUEST;
   }
 
-  // 如果是GET请求且没有请求体，直接处理请求
-  if (m_method == GET && m_content_length == 0)
+  // 同时带有Content-Length的分块请求边界有歧义，HTTP/1.0不支持分块传输，都按非法请求处理
+  if (m_chunked_body && (m_has_content_length || m_version != "1.1"))
   {
-    return do_request();
+    return BAD_REQUEST;
+  }
+
+  // 记录当前请求占用的字节数，之后的字节属于流水线中的下一个请求
+  size_t header_end = request.find("\r\n\r\n");
+  bool body_started = m_read_idx > (int)(header_end + 4);
+
+  // 头部解析完立即检查请求体的大小，超出上限时直接拒绝，不再接收请求体
+  // PUT的请求体边接收边写入文件，上传表单的请求体整体读入内存，上限都为MAX_FILE_SIZE；其余请求的请求体必须能完整放入读缓冲区
+  bool upload_form = m_method == POST && m_is_upload_request;
+  int64_t body_limit = (m_method == PUT || upload_form) ? MAX_FILE_SIZE : READ_BUFFER_SIZE - 1 - (int64_t)(header_end + 4);
+  if (m_content_length > body_limit)
+  {
+    printf("请求体过大: %lld 字节\n", (long long)m_content_length);
+    return PAYLOAD_TOO_LARGE;
   }
 
-  // 处理POST请求或包含请求体的GET请求
-  if (m_content_length > 0)
+  // 分块传输的请求体总长度未知，边解码边按同样的上限检查
+  if (m_chunked_body && !m_chunked)
   {
-    // 检查是否接收到足够的数据
-    size_t header_end = request.find("\r\n\r\n");
-    if (header_end != std::string::npos &&
-        static_cast<size_t>(m_read_idx) < (static_cast<size_t>(m_content_length) + header_end + 4))
+    m_chunked.reset(new chunked_decoder(body_limit));
+  }
+
+  // PUT的请求体不进入读缓冲区，边接收边写入文件
+  if (m_method == PUT)
+  {
+    m_request_len = header_end + 4;
+    if (start_upload() != GET_REQUEST)
+    {
+      return BAD_REQUEST;
+    }
+    // 目标名合法，请求可以接受，通知等待中的客户端开始发送请求体
+    if (!body_started)
     {
-      return NO_REQUEST; // 请求体数据不完整，继续读取
+      send_continue();
     }
+    // 随头部一起读入的请求体移入上传缓冲区，剩下的字节属于下一个请求
+    size_t n = m_chunked ? decode_upload(m_read_buf + m_request_len, m_read_idx - m_request_len)
+                         : m_upload->append(m_read_buf + m_request_len, m_read_idx - m_request_len);
+    memmove(m_read_buf + m_request_len, m_read_buf + m_request_len + n, m_read_idx - m_request_len - n);
+    m_read_idx -= n;
+    m_read_buf[m_read_idx] = '\0';
+    return GET_REQUEST;
+  }
 
-    // 解析请求体
-    ret = parse_content(request);
-    if (ret == BAD_REQUEST)
+  // 上传表单的请求体可能包含多个文件，不经过读缓冲区，整体读入m_body_buf后再解析
+  if (upload_form)
+  {
+    m_request_len = header_end + 4;
+    m_body_buffering = true;
+    if (!m_chunked)
+    {
+      m_body_buf.reserve(m_content_length);
+    }
+    if (!body_started)
+    {
+      send_continue();
+    }
+    size_t n = append_form_body(m_read_buf + m_request_len, m_read_idx - m_request_len);
+    memmove(m_read_buf + m_request_len, m_read_buf + m_request_len + n, m_read_idx - m_request_len - n);
+    m_read_idx -= n;
+    m_read_buf[m_read_idx] = '\0';
+    return form_body_status();
+  }
+
+  if (m_chunked)
+  {
+    // 新收到的原始字节就地解码，解码后的请求体紧跟在头部之后，读缓冲区中不保留分块编码
+    size_t start = header_end + 4 + m_chunked->body_size();
+    size_t consumed, produced;
+    m_chunked->decode(m_read_buf + start, m_read_idx - start, m_read_buf + start, m_read_idx - start, consumed, produced);
+    memmove(m_read_buf + start + produced, m_read_buf + start + consumed, m_read_idx - start - consumed);
+    m_read_idx -= consumed - produced;
+    m_read_buf[m_read_idx] = '\0';
+
+    switch (m_chunked->status())
     {
+    case chunked_decoder::BAD:
       return BAD_REQUEST;
+    case chunked_decoder::TOO_LARGE:
+      return PAYLOAD_TOO_LARGE;
+    case chunked_decoder::MORE:
+      if (!body_started)
+      {
+        send_continue();
+      }
+      // 读缓冲区已满，最后一块永远无法到达
+      return m_read_idx >= READ_BUFFER_SIZE - 1 ? PAYLOAD_TOO_LARGE : NO_REQUEST;
+    default:
+      // 请求体结束，之后按普通请求处理
+      m_content_length = m_chunked->body_size();
+      break;
     }
+  }
+
+  m_request_len = header_end + 4 + m_content_length;
 
-    // 请求体完整，处理请求
-    return do_request();
+  // 检查是否接收到足够的数据
+  if (m_read_idx < m_request_len)
+  {
+    if (!body_started)
+    {
+      send_continue();
+    }
+    return NO_REQUEST; // 请求体数据不完整，继续读取
   }
 
-  return NO_REQUEST;
+  // 请求完整，请求体和目标文件由handle_request处理
+  return GET_REQUEST;
+}
+
+// 请求中涉及文件系统的部分：保存上传的文件、删除文件、stat/open/mmap目标文件
+// 可能被磁盘阻塞，因此在磁盘I/O线程池中执行
+http_conn::HTTP_CODE http_conn::handle_request()
+{
+  if (m_h2)
+  {
+    // HTTP/2流的请求头部和请求体都已经完整收到
+    h2_stream *stream = m_h2->current();
+    return serve_stream(stream->headers, stream->body);
+  }
+  if (m_upload)
+  {
+    return continue_upload();
+  }
+  if (m_body_buffering)
+  {
+    // 上传表单的请求体已经整体收到，保存其中的文件
+    HTTP_CODE ret = handle_body(m_body_buf);
+    if (ret != GET_REQUEST)
+    {
+      return ret;
+    }
+  }
+  else if (m_content_length > 0)
+  {
+    // 解析请求体
+    HTTP_CODE ret = parse_content(std::string(m_read_buf, m_request_len));
+    if (ret != GET_REQUEST)
+    {
+      return ret;
+    }
+  }
+  return do_request();
 }
 
 // 解析HTTP请求行，获得请求方法、目标URL、HTTP版本
@@ -274,16 +1222,7 @@ http_conn::HTTP_CODE http_conn::parse_request_line(const std::string &request)
   }
 
   // 解析方法（支持GET和POST）
-  std::string method = matches[1];
-  if (method == "GET")
-  {
-    m_method = GET;
-  }
-  else if (method == "POST")
-  {
-    m_method = POST;
-  }
-  else
+  if (!parse_method(matches[1]))
   {
     return BAD_REQUEST;
   }
@@ -303,27 +1242,61 @@ http_conn::HTTP_CODE http_conn::parse_request_line(const std::string &request)
       return BAD_REQUEST;
     }
   }
-
-  // 处理URL，必须以/开头
-  if (url.empty() || url[0] != '/')
+
+  // 处理URL，必须以/开头
+  if (url.empty() || url[0] != '/')
+  {
+    return BAD_REQUEST;
+  }
+
+  // 直接赋值给std::string成员变量
+  m_url = url;
+
+  // 解析HTTP版本（支持HTTP/1.0和HTTP/1.1）
+  std::string version = matches[3];
+  if (version != "1.1" && version != "1.0")
+  {
+    return BAD_REQUEST;
+  }
+
+  // 直接赋值给std::string成员变量
+  m_version = version;
+
+  // HTTP/1.1默认保持连接，除非请求带有Connection: close
+  // HTTP/1.0默认响应后关闭连接，除非请求带有Connection: keep-alive
+  m_linger = version == "1.1";
+
+  return m_method == GET ? GET_REQUEST : NO_REQUEST;
+}
+
+// 识别请求方法，不支持的方法返回false
+bool http_conn::parse_method(const std::string &method)
+{
+  if (method == "GET")
+  {
+    m_method = GET;
+  }
+  else if (method == "HEAD")
+  {
+    m_method = HEAD;
+  }
+  else if (method == "POST")
+  {
+    m_method = POST;
+  }
+  else if (method == "PUT")
+  {
+    m_method = PUT;
+  }
+  else if (method == "DELETE")
   {
-    return BAD_REQUEST;
+    m_method = DELETE;
   }
-
-  // 直接赋值给std::string成员变量
-  m_url = url;
-
-  // 解析HTTP版本（只支持HTTP/1.1）
-  std::string version = matches[3];
-  if (version != "1.1")
+  else
   {
-    return BAD_REQUEST;
+    return false;
   }
-
-  // 直接赋值给std::string成员变量
-  m_version = version;
-
-  return m_method == GET ? GET_REQUEST : NO_REQUEST;
+  return true;
 }
 
 // 解析HTTP请求的头部信息
@@ -343,8 +1316,8 @@ http_conn::HTTP_CODE http_conn::parse_headers(const std::string &request)
     return NO_REQUEST;
   }
 
-  // 截取头部部分
-  std::string headers = request.substr(header_start, header_end - header_start);
+  // 截取头部部分，保留最后一行的\r\n，否则最后一个头部无法被正则匹配
+  std::string headers = request.substr(header_start, header_end + 2 - header_start);
 
   // 用正则表达式匹配各个头部字段
   std::regex header_regex("([^:\\r\\n]+):\\s*([^\\r\\n]*)\\r\\n");
@@ -353,57 +1326,125 @@ http_conn::HTTP_CODE http_conn::parse_headers(const std::string &request)
 
   while (it != end)
   {
-    std::string header_name = (*it)[1];
-    std::string header_value = (*it)[2];
+    on_header((*it)[1], (*it)[2]);
+    ++it;
+  }
+
+  // 如果解析完头部后，且没有请求体，则认为是一个完整的GET请求
+  if (m_content_length == 0)
+  {
+    return GET_REQUEST;
+  }
+
+  return NO_REQUEST;
+}
+
+// 客户端带有Expect: 100-continue且还没有发送请求体时，追加100 Continue临时响应
+// 排在之前的响应之后发送，不标记响应结束；HTTP/1.0的客户端不理解临时响应，忽略Expect
+void http_conn::send_continue()
+{
+  if (!m_expect_continue || m_continue_sent || (m_content_length == 0 && !m_chunked) || m_version != "1.1")
+  {
+    return;
+  }
+  m_response.append(http_headers::STATUS_100);
+  m_continue_sent = true;
+}
 
-    // 处理Connection头部
-    if (header_name == "Connection")
+// 处理一个请求头部，HTTP/2的头部名都是小写，因此名字按大小写不敏感比较
+void http_conn::on_header(const std::string &name, const std::string &value)
+{
+  // 处理Connection头部，值是逗号分隔的选项列表，如 keep-alive, Upgrade
+  if (strcasecmp(name.c_str(), "Connection") == 0)
+  {
+    if (strcasestr(value.c_str(), "close"))
     {
-      if (header_value == "keep-alive")
-      {
-        m_linger = true;
-      }
+      m_linger = false;
     }
-    // 处理Content-Length头部
-    else if (header_name == "Content-Length")
+    else if (strcasestr(value.c_str(), "keep-alive"))
     {
-      m_content_length = std::stoi(header_value);
+      m_linger = true;
     }
-    // 处理Host头部
-    else if (header_name == "Host")
+  }
+  // 处理Content-Length头部
+  else if (strcasecmp(name.c_str(), "Content-Length") == 0)
+  {
+    // 64位解析，非数字或负数视为非法请求
+    int64_t len;
+    auto res = std::from_chars(value.data(), value.data() + value.size(), len);
+    m_content_length = (res.ec == std::errc() && len >= 0) ? len : -1;
+    m_has_content_length = true;
+  }
+  // 处理Transfer-Encoding头部，只支持单独的chunked编码，其他编码无法确定请求体的边界
+  else if (strcasecmp(name.c_str(), "Transfer-Encoding") == 0)
+  {
+    m_chunked_body = strcasecmp(value.c_str(), "chunked") == 0;
+    if (!m_chunked_body)
     {
-      // 直接赋值给std::string成员变量
-      m_host = header_value;
+      m_content_length = -1;
     }
-    // 处理Content-Type头部，用于文件上传
-    else if (header_name == "Content-Type")
+  }
+  // 处理Expect头部，唯一定义的期望是100-continue
+  else if (strcasecmp(name.c_str(), "Expect") == 0)
+  {
+    m_expect_continue = strcasecmp(value.c_str(), "100-continue") == 0;
+  }
+  // 处理Host头部
+  else if (strcasecmp(name.c_str(), "Host") == 0)
+  {
+    // 直接赋值给std::string成员变量
+    m_host = value;
+  }
+  // 处理Range和If-Range头部，用于断点续传和拖动播放
+  else if (strcasecmp(name.c_str(), "Range") == 0)
+  {
+    m_range = value;
+  }
+  else if (strcasecmp(name.c_str(), "If-Range") == 0)
+  {
+    m_if_range = value;
+  }
+  // 处理条件请求头部，用于浏览器缓存验证
+  else if (strcasecmp(name.c_str(), "If-None-Match") == 0)
+  {
+    m_if_none_match = value;
+  }
+  else if (strcasecmp(name.c_str(), "If-Modified-Since") == 0)
+  {
+    m_if_modified_since = value;
+  }
+  // 处理Accept-Encoding头部，用于选择压缩版本
+  else if (strcasecmp(name.c_str(), "Accept-Encoding") == 0)
+  {
+    m_accept_encoding = parse_accept_encoding(value);
+  }
+  // 处理Content-Type头部，用于文件上传
+  else if (strcasecmp(name.c_str(), "Content-Type") == 0)
+  {
+    m_content_type = value;
+
+    // 检查是否是multipart/form-data表单提交
+    if (m_content_type.find("multipart/form-data") != std::string::npos)
     {
-      m_content_type = header_value;
+      m_is_upload_request = true;
 
-      // 检查是否是multipart/form-data表单提交
-      if (m_content_type.find("multipart/form-data") != std::string::npos)
+      // 提取boundary值
+      size_t boundary_pos = m_content_type.find("boundary=");
+      if (boundary_pos != std::string::npos)
       {
-        m_is_upload_request = true;
-
-        // 提取boundary值
-        size_t boundary_pos = m_content_type.find("boundary=");
-        if (boundary_pos != std::string::npos)
-        {
-          m_boundary = m_content_type.substr(boundary_pos + 9);
-        }
+        m_boundary = m_content_type.substr(boundary_pos + 9);
       }
     }
-
-    ++it;
   }
-
-  // 如果解析完头部后，且没有请求体，则认为是一个完整的GET请求
-  if (m_content_length == 0)
+  // 处理h2c升级相关头部
+  else if (strcasecmp(name.c_str(), "Upgrade") == 0)
   {
-    return GET_REQUEST;
+    m_upgrade_h2c = value.find("h2c") != std::string::npos;
+  }
+  else if (strcasecmp(name.c_str(), "HTTP2-Settings") == 0)
+  {
+    m_http2_settings = value;
   }
-
-  return NO_REQUEST;
 }
 
 // 解析HTTP请求的消息体
@@ -420,223 +1461,297 @@ http_conn::HTTP_CODE http_conn::parse_content(const std::string &request)
   if (request.length() - content_start >= (size_t)m_content_length)
   {
     // 提取请求体内容
-    std::string body = request.substr(content_start, m_content_length);
-
-    // 处理文件上传请求
-    if (m_is_upload_request && !m_boundary.empty())
-    {
-      return handle_file_upload(body);
-    }
-    // 处理文件删除请求
-    else if (m_url == "/delete")
-    {
-      printf("接收到删除文件请求: %s\n", body.c_str());
-      // 设置checked_idx位置，让do_request能正确解析请求体
-      m_checked_idx = content_start;
-    }
-    else
-    {
-      printf("接收到POST请求体: %s\n", body.c_str());
-    }
-
-    // 成功解析POST请求，返回GET_REQUEST表示一个完整的请求
-    return GET_REQUEST;
+    return handle_body(request.substr(content_start, m_content_length));
   }
 
   return NO_REQUEST;
 }
 
-// 处理文件上传请求
-http_conn::HTTP_CODE http_conn::handle_file_upload(const std::string &request_body)
+// 处理完整的请求体，HTTP/1.1和HTTP/2共用
+http_conn::HTTP_CODE http_conn::handle_body(const std::string &body)
 {
-  // 检查文件上传目录是否存在
-  struct stat dir_stat;
-  if (stat(UPLOAD_DIR.c_str(), &dir_stat) < 0 || !S_ISDIR(dir_stat.st_mode))
+  // 处理文件上传请求
+  if (m_is_upload_request && !m_boundary.empty())
   {
-    // 目录不存在，尝试创建
-    if (mkdir(UPLOAD_DIR.c_str(), 0755) < 0)
-    {
-      printf("创建上传目录失败: %s\n", strerror(errno));
-      return INTERNAL_ERROR;
-    }
+    return handle_file_upload(body);
+  }
+  // 处理文件删除请求，保存请求体让do_request解析文件名
+  else if (m_url == "/delete")
+  {
+    printf("接收到删除文件请求: %s\n", body.c_str());
+    m_form_body = body;
+  }
+  else
+  {
+    printf("接收到POST请求体: %s\n", body.c_str());
   }
 
-  // 解析多部分表单数据
-  std::map<std::string, std::string> form_data = parse_multipart_form_data(request_body);
+  // 成功解析POST请求，返回GET_REQUEST表示一个完整的请求
+  return GET_REQUEST;
+}
 
-  // 检查是否找到上传的文件
-  if (form_data.find("file_content") != form_data.end() && !m_upload_file_name.empty())
+// PUT /uploads/<name>：检查目标文件名并准备上传缓冲区，临时文件在磁盘I/O线程中创建
+http_conn::HTTP_CODE http_conn::start_upload()
+{
+  std::string name;
+  if (!parse_upload_url(m_url, name))
   {
-    // 保存上传的文件
-    bool save_result = save_uploaded_file(form_data["file_content"], m_upload_file_name);
-    if (!save_result)
-    {
-      printf("保存上传文件失败\n");
-      return INTERNAL_ERROR;
-    }
+    return BAD_REQUEST;
+  }
+  m_upload.reset(new upload_sink(upload_layout::path(UPLOAD_DIR, name), m_chunked ? upload_sink::UNKNOWN_LENGTH : m_content_length));
+  return GET_REQUEST;
+}
 
-    // 保存文件描述信息（如果有）
-    if (form_data.find("description") != form_data.end() && !form_data["description"].empty())
+// 把上传缓冲区中的请求体写入临时文件，请求体全部写完后重命名为目标文件
+http_conn::HTTP_CODE http_conn::continue_upload()
+{
+  // 分块编码的请求体格式错误或超过上限，剩余的请求体无法跳过，响应后关闭连接
+  if (m_chunked && m_chunked->failed())
+  {
+    m_linger = false;
+    m_upload.reset();
+    return m_chunked->status() == chunked_decoder::TOO_LARGE ? PAYLOAD_TOO_LARGE : BAD_REQUEST;
+  }
+  if (!m_upload->flush())
+  {
+    // 剩余的请求体无法跳过，响应后关闭连接
+    if (m_upload->remaining() > 0)
     {
-      std::string desc_file_path = UPLOAD_DIR + "/.desc_" + m_upload_file_name;
-      FILE *fp = fopen(desc_file_path.c_str(), "w");
-      if (fp)
-      {
-        fprintf(fp, "%s", form_data["description"].c_str());
-        fclose(fp);
-        printf("保存文件描述成功: %s\n", desc_file_path.c_str());
-      }
+      m_linger = false;
     }
-
-    printf("文件上传成功: %s\n", m_upload_file_name.c_str());
-
-    // 设置响应页面为上传成功页面
-    m_real_file = doc_root + "/post_response.html";
-    return FILE_REQUEST;
+    m_upload.reset();
+    return INTERNAL_ERROR;
+  }
+  if (m_upload->remaining() > 0)
+  {
+    return NO_REQUEST;
   }
 
-  return BAD_REQUEST;
+  bool existed = false;
+  bool committed = m_upload->commit(existed);
+  if (committed)
+  {
+    // PUT没有描述信息，覆盖已有文件时保留原来的描述
+    std::string name;
+    parse_upload_url(m_url, name);
+    meta_store::instance().put(name, {"", m_upload->size(), m_upload->hash(), (int64_t)time(NULL), m_content_type});
+  }
+  m_upload.reset();
+  if (!committed)
+  {
+    return INTERNAL_ERROR;
+  }
+  printf("文件上传成功: %s\n", m_url.c_str());
+  return existed ? NO_CONTENT : CREATED;
 }
 
-// 解析多部分表单数据
-std::map<std::string, std::string> http_conn::parse_multipart_form_data(const std::string &request_body)
+// GET /archive?files=a,b,c：把上传目录中的多个文件打包成tar下载，文件名各自经过URL解码
+// 不带files参数时打包整个上传目录。这里只stat成员确定归档长度，文件在发送到时才打开
+http_conn::HTTP_CODE http_conn::start_archive()
 {
-  std::map<std::string, std::string> form_data;
+  std::unique_ptr<archive_stream> archive(new archive_stream(UPLOAD_DIR));
 
-  // 如果boundary为空，则无法解析
-  if (m_boundary.empty())
+  std::string files;
+  bool has_files = false;
+  size_t pos = m_url.find('?');
+  while (pos != std::string::npos)
   {
-    return form_data;
+    size_t end = m_url.find('&', pos + 1);
+    std::string param = m_url.substr(pos + 1, end == std::string::npos ? std::string::npos : end - pos - 1);
+    if (param.compare(0, 6, "files=") == 0)
+    {
+      files = param.substr(6);
+      has_files = true;
+    }
+    pos = end;
   }
 
-  // 添加--前缀以匹配分界线
-  std::string boundary = "--" + m_boundary;
-  std::string end_boundary = "--" + m_boundary + "--";
-
-  // 在表单数据中查找分界线
-  size_t pos = request_body.find(boundary);
-  while (pos != std::string::npos && request_body.compare(pos, end_boundary.length(), end_boundary) != 0)
+  if (!has_files)
+  {
+    archive->add_all();
+  }
+  else
   {
-    // 寻找下一个分界线
-    size_t next_boundary = request_body.find(boundary, pos + boundary.length());
-    if (next_boundary == std::string::npos)
+    size_t start = 0;
+    while (start <= files.size())
     {
-      // 如果找不到下一个分界线，尝试查找结束分界线
-      next_boundary = request_body.find(end_boundary, pos + boundary.length());
-      if (next_boundary == std::string::npos)
+      size_t comma = files.find(',', start);
+      if (comma == std::string::npos)
       {
-        // 如果结束分界线也找不到，退出循环
-        break;
+        comma = files.size();
+      }
+      std::string name = url_decode(files.substr(start, comma - start), true);
+      if (!valid_upload_name(name))
+      {
+        return BAD_REQUEST;
       }
+      if (!archive->add(name))
+      {
+        return NO_RESOURCE;
+      }
+      start = comma + 1;
     }
+  }
+
+  m_file_stat.st_size = archive->size();
+  m_dynamic_body = true;
+  m_archive = std::move(archive);
+  return FILE_REQUEST;
+}
 
-    // 提取当前部分（不包括分界线）
-    size_t part_start = pos + boundary.length();
-    // 跳过boundary后的\r\n
-    if (request_body.substr(part_start, 2) == "\r\n")
+// GET /api/files?q=&offset=&limit=：按文件名排序分页列出文件，q非空时只列出文件名包含q的文件(不区分ASCII大小写)
+// 只访问元数据的内存索引；ETag是元数据的版本号，未修改时不搜索直接返回304
+http_conn::HTTP_CODE http_conn::list_files()
+{
+  std::string query;
+  size_t offset = 0, limit = LIST_PAGE_SIZE;
+  size_t pos = m_url.find('?');
+  while (pos != std::string::npos)
+  {
+    size_t end = m_url.find('&', pos + 1);
+    std::string param = m_url.substr(pos + 1, end == std::string::npos ? std::string::npos : end - pos - 1);
+    if (param.compare(0, 2, "q=") == 0)
     {
-      part_start += 2;
+      query = url_decode(param.substr(2), true);
     }
-    size_t part_end = next_boundary;
-    // 确保不会越界
-    if (part_start >= request_body.length() || part_start >= part_end)
+    else if (param.compare(0, 7, "offset=") == 0)
     {
-      pos = next_boundary;
-      continue;
+      offset = strtoull(param.c_str() + 7, NULL, 10);
     }
-
-    std::string part = request_body.substr(part_start, part_end - part_start);
-
-    // 查找头部和内容的分隔符（空行，即\r\n\r\n）
-    size_t headers_end = part.find("\r\n\r\n");
-
-    if (headers_end != std::string::npos)
+    else if (param.compare(0, 6, "limit=") == 0)
     {
-      std::string headers = part.substr(0, headers_end);
-      std::string content = part.substr(headers_end + 4);
-
-      // 检查是否包含Content-Disposition头
-      if (headers.find("Content-Disposition:") != std::string::npos)
-      {
-        // 检查是否是文件字段
-        if (headers.find("filename=") != std::string::npos)
-        {
-          // 提取文件名
-          std::regex filename_regex("filename=\"([^\"]+)\"");
-          std::smatch matches;
-          if (std::regex_search(headers, matches, filename_regex))
-          {
-            m_upload_file_name = matches[1];
-          }
-          // 如果没找到文件名，返回一个默认名称
-          else
-          {
-            m_upload_file_name = "unknown_file";
-          }
-          // 如果文件内容是二进制，移除结尾的\r\n
-          if (!content.empty() && content.substr(content.length() - 2) == "\r\n")
-          {
-            content = content.substr(0, content.length() - 2);
-          }
+      limit = std::min<size_t>(strtoull(param.c_str() + 6, NULL, 10), (size_t)LIST_PAGE_MAX);
+    }
+    pos = end;
+  }
 
-          // 保存文件内容
-          form_data["file_content"] = content;
-        }
-        else
-        {
-          // 普通表单字段，提取字段名和值
-          // 从Content-Disposition头中提取文件名
-          std::regex field_regex("name=\"([^\"]+)\"");
-          std::smatch matches;
-          if (std::regex_search(headers, matches, field_regex))
-          {
-            std::string field_name = matches[1];
+  int64_t changed;
+  m_etag = '"' + meta_store::instance().version(changed) + '"';
+  m_file_stat.st_mtime = changed;
+  if (is_not_modified())
+  {
+    return NOT_MODIFIED;
+  }
 
-            // 移除结尾的\r\n
-            if (!content.empty() && content.substr(content.length() - 2) == "\r\n")
-            {
-              content = content.substr(0, content.length() - 2);
-            }
+  std::vector<std::pair<std::string, file_meta>> page;
+  std::string version;
+  size_t total = meta_store::instance().search(query, offset, limit, page, version, changed);
+  m_etag = '"' + version + '"';
+  m_file_stat.st_mtime = changed;
+
+  std::shared_ptr<std::string> json = std::make_shared<std::string>();
+  std::string &out = *json;
+  out.reserve(64 + page.size() * 160);
+  out += "{\"total\":" + std::to_string(total) + ",\"offset\":" + std::to_string(offset) + ",\"files\":[";
+  for (size_t i = 0; i < page.size(); i++)
+  {
+    const file_meta &meta = page[i].second;
+    out += i == 0 ? "{\"name\":" : ",{\"name\":";
+    append_json_string(out, page[i].first);
+    out += ",\"size\":" + std::to_string(meta.size) + ",\"time\":" + std::to_string(meta.upload_time) + ",\"type\":";
+    append_json_string(out, meta.content_type);
+    out += ",\"hash\":";
+    append_json_string(out, meta.hash);
+    out += ",\"description\":";
+    append_json_string(out, meta.description);
+    out += '}';
+  }
+  out += "]}";
 
-            form_data[field_name] = content;
-          }
-        }
-      }
-    }
+  m_file_address = std::shared_ptr<char>(json, &out[0]);
+  m_file_stat.st_size = out.size();
+  return FILE_REQUEST;
+}
 
-    // 移动到下一个部分
-    pos = next_boundary;
+// DELETE /uploads/<name>：删除文件及其描述
+http_conn::HTTP_CODE http_conn::delete_object()
+{
+  std::string name;
+  if (!parse_upload_url(m_url, name))
+  {
+    return NO_RESOURCE;
   }
 
-  return form_data;
+  std::string file_path = upload_layout::path(UPLOAD_DIR, name);
+  struct stat file_stat;
+  if (stat(file_path.c_str(), &file_stat) < 0 || !S_ISREG(file_stat.st_mode))
+  {
+    return NO_RESOURCE;
+  }
+  if (!content_store::instance().remove(file_path))
+  {
+    printf("文件 %s 删除失败: %s\n", name.c_str(), strerror(errno));
+    return INTERNAL_ERROR;
+  }
+  meta_store::instance().remove(name);
+  printf("文件 %s 成功删除\n", name.c_str());
+  return NO_CONTENT;
 }
 
-// 保存上传的文件
-bool http_conn::save_uploaded_file(const std::string &file_content, const std::string &file_name)
+// 处理文件上传请求，表单中的每个文件都会保存，多个文件并行写入
+// 描述按顺序对应文件：第i个description字段属于第i个文件，只有一个description时属于所有文件
+http_conn::HTTP_CODE http_conn::handle_file_upload(const std::string &request_body)
 {
-  // 构造完整的文件路径
-  std::string file_path = UPLOAD_DIR + "/" + file_name;
+  // 检查文件上传目录是否存在
+  struct stat dir_stat;
+  if (stat(UPLOAD_DIR.c_str(), &dir_stat) < 0 || !S_ISDIR(dir_stat.st_mode))
+  {
+    // 目录不存在，尝试创建
+    if (mkdir(UPLOAD_DIR.c_str(), 0755) < 0)
+    {
+      printf("创建上传目录失败: %s\n", strerror(errno));
+      return INTERNAL_ERROR;
+    }
+  }
 
-  // 打开文件准备写入
-  FILE *fp = fopen(file_path.c_str(), "wb");
-  if (!fp)
+  // 解析多部分表单数据，各部分的内容直接引用请求体
+  std::vector<form_part> parts;
+  if (!parse_multipart(request_body, m_boundary, parts))
   {
-    printf("无法创建文件: %s\n", file_path.c_str());
-    return false;
+    return BAD_REQUEST;
   }
 
-  // 写入文件内容
-  size_t written = fwrite(file_content.c_str(), 1, file_content.length(), fp);
-  fclose(fp);
+  std::vector<const form_part *> files;
+  std::vector<std::string_view> descriptions;
+  for (const form_part &part : parts)
+  {
+    // 没有选择文件的文件字段，浏览器也会发送一个文件名为空的部分
+    if (part.is_file && !part.filename.empty())
+    {
+      files.push_back(&part);
+    }
+    else if (!part.is_file && part.name == "description")
+    {
+      descriptions.push_back(part.content);
+    }
+  }
+  if (files.empty())
+  {
+    return BAD_REQUEST;
+  }
 
-  // 检查是否写入成功
-  if (written != file_content.length())
+  upload_batch batch;
+  for (size_t i = 0; i < files.size(); i++)
   {
-    printf("写入文件失败: %s\n", file_path.c_str());
-    return false;
+    // 部分浏览器发送的是完整路径，只保留最后一段
+    std::string name = files[i]->filename.substr(files[i]->filename.find_last_of("/\\") + 1);
+    if (!valid_upload_name(name))
+    {
+      return BAD_REQUEST;
+    }
+    std::string_view description = descriptions.size() == 1 ? descriptions[0]
+                                   : i < descriptions.size() ? descriptions[i]
+                                                             : std::string_view();
+    batch.add(name, upload_layout::path(UPLOAD_DIR, name), files[i]->content, description, files[i]->content_type);
   }
 
-  return true;
+  if (!batch.run())
+  {
+    printf("保存上传文件失败\n");
+    return INTERNAL_ERROR;
+  }
+  printf("%zu 个文件上传成功\n", files.size());
+  return GET_REQUEST;
 }
 
 // 当得到一个完整、正确的HTTP请求时，我们就分析目标文件的属性
@@ -651,11 +1766,32 @@ http_conn::HTTP_CODE http_conn::do_request()
     m_real_file = doc_root + "/index.html";
   }
 
-  // 处理上传文件夹的请求
+  if (m_method == DELETE)
+  {
+    return delete_object();
+  }
+
+  if ((m_method == GET || m_method == HEAD) &&
+      (m_url == "/archive" || m_url.compare(0, 9, "/archive?") == 0))
+  {
+    return start_archive();
+  }
+
+  if ((m_method == GET || m_method == HEAD) &&
+      (m_url == "/api/files" || m_url.compare(0, 11, "/api/files?") == 0))
+  {
+    return list_files();
+  }
+
+  // 处理上传文件夹的请求，文件名经过URL解码，不允许访问上传目录之外的文件；实际路径按分层布局计算
   if (m_url.compare(0, 9, "/uploads/") == 0)
   {
-    std::string filename = m_url.substr(8); // 去掉/uploads前缀，保留/
-    m_real_file = UPLOAD_DIR + filename;
+    std::string filename;
+    if (!parse_upload_url(m_url, filename))
+    {
+      return NO_RESOURCE;
+    }
+    m_real_file = upload_layout::path(UPLOAD_DIR, filename);
   }
 
   // 对于POST请求，可以根据URL路径和请求体内容做特殊处理
@@ -666,7 +1802,7 @@ http_conn::HTTP_CODE http_conn::do_request()
     // 处理上传请求
     if (m_url == "/upload" && m_is_upload_request)
     {
-      // 上传处理已经在parse_content阶段的handle_file_upload中完成
+      // 上传的文件已经在handle_body阶段由handle_file_upload并行写入
       // 这里设置响应页面
       m_real_file = doc_root + "/post_response.html";
     }
@@ -676,7 +1812,7 @@ http_conn::HTTP_CODE http_conn::do_request()
       printf("处理文件删除请求\n");
 
       // 从请求体中提取文件名
-      std::string request_body(m_read_buf + m_checked_idx, m_content_length);
+      const std::string &request_body = m_form_body;
 
       // 解析表单数据 - application/x-www-form-urlencoded 格式
       std::string filename;
@@ -689,38 +1825,25 @@ http_conn::HTTP_CODE http_conn::do_request()
         {
           end_pos = request_body.length();
         }
-        filename = request_body.substr(pos, end_pos - pos);
-
         // 处理URL编码
-        for (size_t i = 0; i < filename.length(); ++i)
-        {
-          if (filename[i] == '+')
-          {
-            filename[i] = ' ';
-          }
-          else if (filename[i] == '%' && i + 2 < filename.length())
-          {
-            int hex_val = 0;
-            sscanf(filename.substr(i + 1, 2).c_str(), "%x", &hex_val);
-            filename.replace(i, 3, 1, static_cast<char>(hex_val));
-          }
-        }
+        filename = url_decode(request_body.substr(pos, end_pos - pos), true);
       }
 
       printf("尝试删除文件: %s\n", filename.c_str());
 
       // 如果有文件名，尝试删除文件
-      if (!filename.empty())
+      if (valid_upload_name(filename))
       {
-        std::string file_path = UPLOAD_DIR + "/" + filename;
+        std::string file_path = upload_layout::path(UPLOAD_DIR, filename);
 
         // 检查文件是否存在并且是常规文件
         struct stat file_stat;
         if (stat(file_path.c_str(), &file_stat) == 0 && S_ISREG(file_stat.st_mode))
         {
-          // 尝试删除文件
-          if (unlink(file_path.c_str()) == 0)
+          // 尝试删除文件，最后一个引用被删除时回收内容
+          if (content_store::instance().remove(file_path))
           {
+            meta_store::instance().remove(filename);
             printf("文件 %s 成功删除\n", filename.c_str());
           }
           else
@@ -756,20 +1879,59 @@ http_conn::HTTP_CODE http_conn::do_request()
     return NO_RESOURCE;
   }
 
-  // 判断访问权限
-  if (!(m_file_stat.st_mode & S_IROTH))
-  {
-    return FORBIDDEN_REQUEST;
-  }
+  // 判断访问权限
+  if (!(m_file_stat.st_mode & S_IROTH))
+  {
+    return FORBIDDEN_REQUEST;
+  }
+
+  // 判断是否是目录
+  if (S_ISDIR(m_file_stat.st_mode))
+  {
+    return BAD_REQUEST;
+  }
+
+  bool is_index = m_real_file == doc_root + "/index.html";
+
+  if (!is_index)
+  {
+    // 先协商压缩版本，校验器对应实际发送的版本；HEAD只使用已有的压缩版本，不触发后台压缩
+    if (m_method == GET || m_method == HEAD)
+    {
+      select_encoding();
+    }
+    m_etag = make_etag();
+
+    // 条件请求在打开或映射文件之前判断，304响应完全不接触文件数据
+    if ((m_method == GET || m_method == HEAD) && is_not_modified())
+    {
+      return NOT_MODIFIED;
+    }
+
+    // 命中压缩缓存，直接发送内存中的压缩数据
+    if (m_encoded_body)
+    {
+      m_file_address = std::shared_ptr<char>(m_encoded_body, const_cast<char *>(m_encoded_body->data()));
+      m_file_stat.st_size = m_encoded_body->size();
+      return FILE_REQUEST;
+    }
 
-  // 判断是否是目录
-  if (S_ISDIR(m_file_stat.st_mode))
+    // HEAD只需要stat得到的元数据，不打开也不映射文件
+    if (m_method == HEAD)
+    {
+      return FILE_REQUEST;
+    }
+  }
+  else if (m_method == HEAD)
   {
-    return BAD_REQUEST;
+    // 动态页面的长度要生成后才知道，HEAD不生成页面，也不返回Content-Length
+    m_compressible = true;
+    m_dynamic_body = true;
+    return FILE_REQUEST;
   }
 
   // 特殊处理index.html，动态插入文件列表
-  if (m_real_file == doc_root + "/index.html")
+  if (is_index)
   {
     // 读取原始index.html内容
     int fd = open(m_real_file.c_str(), O_RDONLY);
@@ -805,32 +1967,54 @@ http_conn::HTTP_CODE http_conn::do_request()
         size_t end_pos = html_content.find("</p>", content_pos);
         if (end_pos != std::string::npos)
         {
-          // 替换占位符内容为实际文件列表
-          std::string file_list = generate_file_list_html();
-          html_content.replace(content_pos, end_pos + 4 - content_pos, file_list);
+          m_compressible = true;
+          m_dynamic_body = true;
 
-          // 创建临时文件存储修改后的内容
-          char temp_path[128];
-          sprintf(temp_path, "/tmp/index_%d.html", m_sockfd);
-          int temp_fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-          if (temp_fd > 0)
+          // HTTP/1.1连接上边读取目录边以chunked编码发送，列表之前的部分立即发出
+          // HTTP/1.0客户端不支持chunked编码，与HTTP/2一样整体生成
+          if (!m_h2 && !m_upgrade_h2c && m_version == "1.1")
           {
-            ::write(temp_fd, html_content.c_str(), html_content.length());
-            close(temp_fd);
+            bool gzip = m_accept_encoding & ENCODING_GZIP;
+            if (gzip)
+            {
+              m_content_encoding = "gzip";
+            }
+            m_listing.reset(new dir_listing(html_content.substr(0, content_pos),
+                                            html_content.substr(end_pos + 4), gzip));
+            return FILE_REQUEST;
+          }
 
-            // 替换m_real_file为临时文件
-            m_real_file = temp_path;
+          // HTTP/2的响应体由会话整体分帧，替换占位符内容为实际文件列表
+          std::string file_list = dir_listing::render();
+          html_content.replace(content_pos, end_pos + 4 - content_pos, file_list);
 
-            // 更新文件状态
-            stat(m_real_file.c_str(), &m_file_stat);
+          // 渲染后的页面直接保存在内存中作为响应体，不再写临时文件
+          std::shared_ptr<const std::string> page = std::make_shared<std::string>(std::move(html_content));
+          if (m_accept_encoding & ENCODING_GZIP)
+          {
+            // 以内容哈希区分页面版本，同一版本只在后台压缩一次
+            std::string key = m_real_file + '\n' + std::to_string(std::hash<std::string>()(*page));
+            auto compressed = compress_cache::instance().lookup(key);
+            if (!compressed)
+            {
+              compress_cache::instance().submit_buffer(key, page);
+            }
+            else if (!compressed->empty())
+            {
+              page = compressed;
+              m_content_encoding = "gzip";
+            }
           }
+          m_file_address = std::shared_ptr<char>(page, const_cast<char *>(page->data()));
+          m_file_stat.st_size = page->size();
+          return FILE_REQUEST;
         }
       }
     }
   }
 
-  // 以只读方式打开文件
-  int fd = open(m_real_file.c_str(), O_RDONLY);
+  // 以只读方式打开文件，选中了预压缩文件时打开压缩文件
+  int fd = open(m_body_file.empty() ? m_real_file.c_str() : m_body_file.c_str(), O_RDONLY);
   if (fd < 0)
   {
     return NO_RESOURCE;
@@ -838,283 +2022,514 @@ http_conn::HTTP_CODE http_conn::do_request()
 
   // 先清除之前的映射
   m_file_address.reset();
+  m_file_window.reset();
 
-  // 创建内存映射
-  char *addr = (char *)mmap(0, m_file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-  close(fd);
+  // 空文件无法映射，也没有响应体
+  if (m_file_stat.st_size == 0)
+  {
+    close(fd);
+    return FILE_REQUEST;
+  }
+
+  // 小文件直接pread到池化的缓冲区，省去mmap/munmap，以及多线程进程中munmap引起的TLB shootdown
+  if ((uint64_t)m_file_stat.st_size <= m_pread_max_size)
+  {
+    std::shared_ptr<char> buf = file_buffer_pool::instance().acquire();
+    size_t len = m_file_stat.st_size;
+    size_t done = 0;
+    while (done < len)
+    {
+      ssize_t n = pread(fd, buf.get() + done, len - done, done);
+      if (n < 0 && errno == EINTR)
+      {
+        continue;
+      }
+      if (n <= 0)
+      {
+        break;
+      }
+      done += n;
+    }
+    close(fd);
+    if (done < len)
+    {
+      // 读取失败或文件在stat之后被截断
+      return INTERNAL_ERROR;
+    }
+    m_file_address = buf;
+    return FILE_REQUEST;
+  }
+
+  // 大文件不整体映射，发送时按窗口映射，并预读下一个窗口
+  if ((uint64_t)m_file_stat.st_size > POPULATE_MAX_SIZE)
+  {
+    posix_fadvise(fd, 0, file_window::WINDOW_SIZE, POSIX_FADV_WILLNEED);
+    m_file_window = std::make_shared<file_window>(fd, m_file_stat.st_size);
+    return FILE_REQUEST;
+  }
 
+  // 中等大小的文件映射时直接填充页表，零拷贝引用，发送时不再触发缺页
+  size_t map_len = m_file_stat.st_size;
+  char *addr = (char *)mmap(0, map_len, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+  close(fd);
   if (addr == MAP_FAILED)
   {
     return INTERNAL_ERROR;
   }
 
   // 使用自定义删除器的智能指针
-  m_file_address = std::shared_ptr<char>(addr, [this](char *p)
+  m_file_address = std::shared_ptr<char>(addr, [map_len](char *p)
                                          {
     if (p != nullptr && p != MAP_FAILED) {
-      munmap(p, m_file_stat.st_size);
+      munmap(p, map_len);
     } });
 
   return FILE_REQUEST;
 }
 
-// 生成文件列表HTML
-std::string http_conn::generate_file_list_html()
+// 往写缓冲中写入待发送的数据
+bool http_conn::add_status_line(int status)
+{
+  return add_response(http_headers::status_line(status));
+}
+
+void http_conn::add_headers(int64_t content_len)
+{
+  add_content_length(content_len);
+  add_content_type();
+  add_linger();
+  add_blank_line();
+}
+
+bool http_conn::add_content_length(int64_t content_len)
 {
-  std::string file_list_html = "";
+  add_response(http_headers::CONTENT_LENGTH);
+  m_response.append_number(content_len);
+  return add_response(http_headers::CRLF);
+}
+
+// 以零拷贝方式追加响应体中[offset, offset+len)的部分，大文件按窗口引用
+void http_conn::add_body(uint64_t offset, uint64_t len)
+{
+  // HEAD的响应与GET的头部相同，但不带响应体
+  if (m_method == HEAD)
+  {
+    return;
+  }
+  if (m_file_window)
+  {
+    m_response.append_file(m_file_window, offset, len);
+  }
+  else
+  {
+    m_response.append_external(m_file_address.get() + offset, len, m_file_address);
+  }
+}
 
-  // 打开uploads目录
-  DIR *dir = opendir(UPLOAD_DIR.c_str());
-  if (dir == NULL)
+// 以chunked编码追加一块数据，空数据会被当作结束块，直接跳过
+void http_conn::add_chunk(const std::string &data)
+{
+  if (data.empty())
   {
-    return "<p>无法访问上传目录。</p>";
+    return;
   }
+  char num[20];
+  m_response.append(std::string_view(num, std::to_chars(num, num + sizeof(num), data.size(), 16).ptr - num));
+  add_response(http_headers::CRLF);
+  m_response.append(data);
+  add_response(http_headers::CRLF);
+}
+
+// 文件列表页面的头部和列表之前的部分，列表本身在发送完后分批生成
+bool http_conn::add_listing_head()
+{
+  add_status_line(200);
+  add_content_type();
+  add_encoding_headers();
+  add_response(http_headers::TRANSFER_CHUNKED);
+  add_validators();
+  add_linger();
+  add_blank_line();
 
-  // 存储文件列表
-  std::vector<std::string> files;
-  struct dirent *entry;
-  while ((entry = readdir(dir)) != NULL)
+  std::string data;
+  m_listing->begin(data);
+  add_chunk(data);
+  return true;
+}
+
+// 打包下载的响应头，长度在添加成员时已经确定，成员在头部发送完后分批追加
+bool http_conn::add_archive_head()
+{
+  add_status_line(200);
+  add_content_length(m_file_stat.st_size);
+  add_response(http_headers::TYPE_TAR);
+  add_response(http_headers::DISPOSITION_ATTACHMENT);
+  add_response("uploads.tar\"\r\n");
+  add_linger();
+  add_blank_line();
+
+  if (m_method == HEAD)
+  {
+    m_archive.reset();
+  }
+  else if (m_h2)
   {
-    // 跳过.和..目录以及隐藏文件
-    if (entry->d_name[0] == '.')
+    // HTTP/2的响应体由会话分帧，这里只追加第一批，其余成员随m_archive交给会话，在该流待发送的数据不足时追加
+    if (m_archive->next(m_response))
     {
-      continue;
+      m_archive.reset();
     }
+    m_response.end_response(m_linger);
+    return true;
+  }
+
+  if (!m_archive)
+  {
+    m_response.end_response(m_linger);
+  }
+  return true;
+}
 
-    // 构建完整路径
-    std::string full_path = UPLOAD_DIR + "/" + entry->d_name;
+// 根据目标文件扩展名确定Content-Type头部行，attachment返回是否需要以附件形式下载
+std::string_view http_conn::content_type_header(bool *attachment) const
+{
+  bool is_upload = m_url.compare(0, 9, "/uploads/") == 0;
 
-    // 检查是否是普通文件
-    struct stat file_stat;
-    if (stat(full_path.c_str(), &file_stat) == 0 && S_ISREG(file_stat.st_mode))
-    {
-      files.push_back(entry->d_name);
-    }
+  if (m_url.compare(0, 5, "/api/") == 0)
+  {
+    return http_headers::TYPE_JSON;
   }
-  closedir(dir);
 
-  // 如果没有文件，显示相应信息
-  if (files.empty())
+  if (m_real_file.find_last_of('.') == std::string::npos)
   {
-    return "<p>目前没有文件，请到表单页面上传文件。</p>";
+    // 没有扩展名，对于上传文件夹的文件，默认使用UTF-8编码的文本
+    return is_upload ? http_headers::TYPE_TEXT : http_headers::TYPE_HTML;
   }
 
-  // 按字母顺序排序文件
-  std::sort(files.begin(), files.end());
+  // 根据扩展名查找MIME类型，未知类型默认作为二进制流处理
+  const http_headers::mime_entry *mime = target_mime();
+  if (!mime)
+  {
+    return http_headers::TYPE_OCTET_STREAM;
+  }
 
-  // 构建文件列表HTML
-  file_list_html = "<ul class=\"files\">\n";
-  for (const auto &file : files)
+  // 对于上传目录中的txt文件，强制浏览器下载而不是内联显示
+  if (attachment)
   {
-    // 获取文件描述信息
-    std::string desc_file_path = UPLOAD_DIR + "/.desc_" + file;
-    std::string description = "";
-    FILE *fp = fopen(desc_file_path.c_str(), "r");
-    if (fp)
-    {
-      char desc_buf[1024] = {0};
-      if (fgets(desc_buf, sizeof(desc_buf), fp))
-      {
-        description = desc_buf;
-      }
-      fclose(fp);
-    }
+    *attachment = is_upload && mime->ext == "txt";
+  }
+  return mime->header;
+}
 
-    // 文件大小信息
-    std::string full_path = UPLOAD_DIR + "/" + file;
-    struct stat file_stat;
-    stat(full_path.c_str(), &file_stat);
+// 获取目标文件扩展名对应的MIME表项，扩展名只提取一次，查表时大小写不敏感，不需要再转换
+const http_headers::mime_entry *http_conn::target_mime() const
+{
+  size_t dot_pos = m_real_file.find_last_of('.');
+  if (dot_pos == std::string::npos)
+  {
+    return nullptr;
+  }
+  return http_headers::lookup_mime(std::string_view(m_real_file).substr(dot_pos + 1));
+}
 
-    // 计算可读的文件大小
-    std::string size_str;
-    if (file_stat.st_size < 1024)
-    {
-      size_str = std::to_string(file_stat.st_size) + " B";
-    }
-    else if (file_stat.st_size < 1024 * 1024)
-    {
-      size_str = std::to_string(file_stat.st_size / 1024) + " KB";
-    }
-    else
-    {
-      size_str = std::to_string(file_stat.st_size / (1024 * 1024)) + " MB";
-    }
+bool http_conn::add_content_type()
+{
+  bool attachment = false;
+  if (!add_response(content_type_header(&attachment)))
+  {
+    return false;
+  }
 
-    // 添加文件链接、大小、描述和删除按钮
-    file_list_html += "  <li>\n";
-    file_list_html += "    <div>\n";
-    file_list_html += "      <a href=\"/uploads/" + file + "\">" + file + "</a>\n";
-    file_list_html += "      <span class=\"file-size\">" + size_str + "</span>\n";
-    if (!description.empty())
+  // 添加Content-Disposition头，强制浏览器以附件形式处理而不是直接显示
+  if (attachment)
+  {
+    std::string_view filename = std::string_view(m_url).substr(m_url.find_last_of('/') + 1);
+    if (!filename.empty())
     {
-      file_list_html += "      <div class=\"file-desc\">" + description + "</div>\n";
+      return add_response(http_headers::DISPOSITION_ATTACHMENT) &&
+             add_response(filename) &&
+             add_response("\"\r\n");
     }
-    file_list_html += "    </div>\n";
-    file_list_html += "    <div class=\"file-actions\">\n";
-    file_list_html += "      <form action=\"/delete\" method=\"POST\">\n";
-    file_list_html += "        <input type=\"hidden\" name=\"filename\" value=\"" + file + "\">\n";
-    file_list_html += "        <button type=\"submit\" class=\"delete-btn\">删除</button>\n";
-    file_list_html += "      </form>\n";
-    file_list_html += "    </div>\n";
-    file_list_html += "  </li>\n";
   }
-  file_list_html += "</ul>\n";
 
-  return file_list_html;
+  return true;
 }
 
-// 往写缓冲中写入待发送的数据
-bool http_conn::add_status_line(int status, const char *title)
+bool http_conn::add_linger()
 {
-  return add_response("%s %d %s\r\n", "HTTP/1.1", status, title);
+  return add_response(m_linger ? http_headers::CONNECTION_KEEP_ALIVE : http_headers::CONNECTION_CLOSE);
 }
 
-void http_conn::add_headers(int content_len)
+bool http_conn::add_blank_line()
 {
-  add_content_length(content_len);
-  add_content_type();
-  add_linger();
-  add_blank_line();
+  return add_response(http_headers::CRLF);
 }
 
-bool http_conn::add_content_length(int content_len)
+bool http_conn::add_content(const char *content)
 {
-  return add_response("Content-Length: %d\r\n", content_len);
+  if (m_method == HEAD)
+  {
+    return true;
+  }
+  return add_response(content);
 }
 
-bool http_conn::add_content_type()
+// 按长度直接追加到响应构建器，不再经过格式化，也不再受固定写缓冲区大小的限制
+bool http_conn::add_response(std::string_view data)
 {
-  // 获取文件扩展名
-  size_t dot_pos = m_real_file.find_last_of('.');
-  std::string content_type = "text/html";
-  bool add_disposition = false;
-  std::string filename = "";
+  m_response.append(data);
+  return true;
+}
 
-  // 提取文件名，用于Content-Disposition头
-  if (m_url.compare(0, 9, "/uploads/") == 0)
+// 返回206部分内容，单个区间直接发送文件切片，多个区间使用multipart/byteranges
+bool http_conn::add_partial_content(const std::vector<byte_range> &ranges)
+{
+  std::string_view type = content_type_header(nullptr);
+
+  if (ranges.size() == 1)
   {
-    size_t last_slash = m_url.find_last_of('/');
-    if (last_slash != std::string::npos)
-    {
-      filename = m_url.substr(last_slash + 1);
+    const byte_range &r = ranges[0];
+    add_status_line(206);
+    add_content_length(r.length());
+    add_response(type);
+    add_response(http_headers::CONTENT_RANGE);
+    m_response.append_number(r.first);
+    add_response("-");
+    m_response.append_number(r.last);
+    add_response("/");
+    m_response.append_number(m_file_stat.st_size);
+    add_response(http_headers::CRLF);
+    add_response(http_headers::ACCEPT_RANGES);
+    add_encoding_headers();
+    add_validators();
+    add_linger();
+    add_blank_line();
+    add_body(r.first, r.length());
+    m_response.end_response(m_linger);
+    return true;
+  }
 
-      // 对于txt文件，强制浏览器下载而不是内联显示
-      if (dot_pos != std::string::npos)
-      {
-        std::string extension = m_real_file.substr(dot_pos);
-        std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
-        if (extension == ".txt")
-        {
-          add_disposition = true;
-        }
-      }
-    }
+  // 分界线由文件的inode、修改时间和大小生成
+  char boundary[32];
+  uint64_t seed = (uint64_t)m_file_stat.st_ino ^ ((uint64_t)m_file_stat.st_mtime << 20) ^ (uint64_t)m_file_stat.st_size;
+  char *boundary_end = std::to_chars(boundary, boundary + sizeof(boundary), seed, 16).ptr;
+  std::string_view boundary_str(boundary, boundary_end - boundary);
+
+  // 先生成每个部分的头部，以便计算Content-Length
+  std::vector<std::string> part_headers;
+  part_headers.reserve(ranges.size());
+  int64_t total = 0;
+  for (size_t i = 0; i < ranges.size(); ++i)
+  {
+    std::string part = i == 0 ? "--" : "\r\n--";
+    part.append(boundary_str);
+    part.append(http_headers::CRLF);
+    part.append(type);
+    part.append(http_headers::CONTENT_RANGE);
+    part.append(std::to_string(ranges[i].first) + "-" + std::to_string(ranges[i].last) + "/" + std::to_string(m_file_stat.st_size));
+    part.append("\r\n\r\n");
+    total += part.size() + ranges[i].length();
+    part_headers.push_back(std::move(part));
+  }
+  std::string trailer = "\r\n--";
+  trailer.append(boundary_str);
+  trailer.append("--\r\n");
+  total += trailer.size();
+
+  add_status_line(206);
+  add_content_length(total);
+  add_response(http_headers::MULTIPART_BYTERANGES);
+  add_response(boundary_str);
+  add_response(http_headers::CRLF);
+  add_response(http_headers::ACCEPT_RANGES);
+  add_encoding_headers();
+  add_validators();
+  add_linger();
+  add_blank_line();
+  for (size_t i = 0; i < ranges.size(); ++i)
+  {
+    add_response(part_headers[i]);
+    add_body(ranges[i].first, ranges[i].length());
   }
+  add_response(trailer);
+  m_response.end_response(m_linger);
+  return true;
+}
 
-  if (dot_pos != std::string::npos)
+// 按Accept-Encoding选择压缩版本：优先使用.br/.gz预压缩文件，其次使用后台压缩的缓存结果
+void http_conn::select_encoding()
+{
+  const http_headers::mime_entry *mime = target_mime();
+  m_compressible = mime && mime->compressible;
+  if (!m_compressible || m_accept_encoding == ENCODING_NONE)
   {
-    std::string extension = m_real_file.substr(dot_pos);
+    return;
+  }
 
-    // 转换为小写
-    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+  static const struct
+  {
+    int flag;
+    const char *suffix;
+    std::string_view name;
+  } variants[] = {{ENCODING_BR, ".br", "br"}, {ENCODING_GZIP, ".gz", "gzip"}};
 
-    // 根据扩展名设置不同的MIME类型
-    if (extension == ".html" || extension == ".htm")
-    {
-      content_type = "text/html; charset=UTF-8";
-    }
-    else if (extension == ".txt")
-    {
-      content_type = "text/plain; charset=UTF-8";
-    }
-    else if (extension == ".jpg" || extension == ".jpeg")
-    {
-      content_type = "image/jpeg";
-    }
-    else if (extension == ".png")
-    {
-      content_type = "image/png";
-    }
-    else if (extension == ".gif")
-    {
-      content_type = "image/gif";
-    }
-    else if (extension == ".css")
-    {
-      content_type = "text/css; charset=UTF-8";
-    }
-    else if (extension == ".js")
-    {
-      content_type = "application/javascript; charset=UTF-8";
-    }
-    else if (extension == ".pdf")
+  for (const auto &variant : variants)
+  {
+    if (!(m_accept_encoding & variant.flag))
     {
-      content_type = "application/pdf";
+      continue;
     }
-    else if (extension == ".mp3")
+    // 预压缩文件比原文件旧时视为过期，不使用
+    std::string path = m_real_file + variant.suffix;
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode) && st.st_mtime >= m_file_stat.st_mtime)
     {
-      content_type = "audio/mpeg";
+      m_body_file = path;
+      m_file_stat = st;
+      m_content_encoding = variant.name;
+      return;
     }
-    else if (extension == ".mp4")
+  }
+
+  if (m_accept_encoding & ENCODING_GZIP)
+  {
+    // key中包含原文件的ETag，文件修改后自然对应新的缓存项
+    std::string key = m_real_file + '\n' + make_etag();
+    compress_cache &cache = compress_cache::instance();
+    std::shared_ptr<const std::string> compressed = cache.lookup(key);
+    if (!compressed)
     {
-      content_type = "video/mp4";
+      // 未命中时只有GET提交后台压缩，HEAD按未压缩的版本回答
+      if (m_method == GET)
+      {
+        cache.submit_file(key, m_real_file, m_file_stat.st_size,
+                          (int64_t)m_file_stat.st_mtim.tv_sec * 1000000000ll + m_file_stat.st_mtim.tv_nsec);
+      }
     }
-    else
+    else if (!compressed->empty())
     {
-      // 默认作为二进制流处理
-      content_type = "application/octet-stream";
+      m_encoded_body = compressed;
+      m_content_encoding = "gzip";
     }
   }
-  else
+}
+
+// 添加Vary和Content-Encoding头部
+bool http_conn::add_encoding_headers()
+{
+  if (m_compressible)
   {
-    // 没有扩展名，对于上传文件夹的文件，默认使用UTF-8编码的文本
-    if (m_url.compare(0, 9, "/uploads/") == 0)
-    {
-      content_type = "text/plain; charset=UTF-8";
-    }
+    add_response(http_headers::VARY_ENCODING);
   }
-
-  add_response("Content-Type: %s\r\n", content_type.c_str());
-
-  // 添加Content-Disposition头，强制浏览器以附件形式处理而不是直接显示
-  if (add_disposition && !filename.empty())
+  if (!m_content_encoding.empty())
   {
-    add_response("Content-Disposition: attachment; filename=\"%s\"\r\n", filename.c_str());
+    add_response(http_headers::CONTENT_ENCODING);
+    add_response(m_content_encoding);
+    add_response(http_headers::CRLF);
   }
-
   return true;
 }
 
-bool http_conn::add_linger()
-{
-  return add_response("Connection: %s\r\n", (m_linger == true) ? "keep-alive" : "close");
-}
-
-bool http_conn::add_blank_line()
+// 强校验器，上传的文件使用内容的SHA-256，其余文件由inode、大小和纳秒级修改时间生成，都不需要读取文件内容
+// 压缩版本的ETag带有编码后缀，与原始内容区分
+std::string http_conn::make_etag() const
 {
-  return add_response("%s", "\r\n");
+  char num[20];
+  std::string etag = "\"";
+  auto append_hex = [&](uint64_t value)
+  {
+    etag.append(num, std::to_chars(num, num + sizeof(num), value, 16).ptr);
+  };
+  std::string hash;
+  if (content_store::instance().lookup(m_file_stat, hash))
+  {
+    // 内容相同的文件不论文件名和上传时间，ETag都相同
+    etag += hash;
+  }
+  else
+  {
+    append_hex(m_file_stat.st_ino);
+    etag += '-';
+    append_hex(m_file_stat.st_size);
+    etag += '-';
+    append_hex((uint64_t)m_file_stat.st_mtim.tv_sec * 1000000000ull + m_file_stat.st_mtim.tv_nsec);
+  }
+  if (!m_content_encoding.empty())
+  {
+    etag += '-';
+    etag.append(m_content_encoding);
+  }
+  etag += '"';
+  return etag;
 }
 
-bool http_conn::add_content(const char *content)
+// 添加ETag、Last-Modified和Cache-Control，动态页面不缓存
+bool http_conn::add_validators()
 {
-  return add_response("%s", content);
+  if (m_dynamic_body)
+  {
+    return add_response(http_headers::CACHE_NO_STORE);
+  }
+  add_response(http_headers::ETAG);
+  add_response(m_etag);
+  add_response(http_headers::CRLF);
+  add_response(http_headers::LAST_MODIFIED);
+  add_response(format_http_date(m_file_stat.st_mtime));
+  add_response(http_headers::CRLF);
+  return add_response(http_headers::CACHE_REVALIDATE);
 }
 
-bool http_conn::add_response(const char *format, ...)
+// 根据If-None-Match和If-Modified-Since判断客户端缓存是否仍然有效
+bool http_conn::is_not_modified() const
 {
-  if (m_write_idx >= WRITE_BUFFER_SIZE)
+  // 有If-None-Match时忽略If-Modified-Since
+  if (!m_if_none_match.empty())
   {
+    std::string_view tags(m_if_none_match);
+    if (tags.find('*') != std::string_view::npos)
+    {
+      return true;
+    }
+
+    // GET请求使用弱比较，忽略W/前缀
+    const std::string &etag = m_etag;
+    size_t pos = 0;
+    while ((pos = tags.find(etag, pos)) != std::string_view::npos)
+    {
+      if (pos + etag.size() == tags.size() || tags[pos + etag.size()] == ',' || tags[pos + etag.size()] == ' ')
+      {
+        return true;
+      }
+      pos += etag.size();
+    }
     return false;
   }
-  va_list arg_list;
-  va_start(arg_list, format);
-  int len = vsnprintf(m_write_buf + m_write_idx, WRITE_BUFFER_SIZE - 1 - m_write_idx, format, arg_list);
-  if (len >= (WRITE_BUFFER_SIZE - 1 - m_write_idx))
+
+  if (!m_if_modified_since.empty())
   {
-    return false;
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    const char *end = strptime(m_if_modified_since.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if (end && *end == '\0')
+    {
+      return m_file_stat.st_mtime <= timegm(&tm);
+    }
   }
-  m_write_idx += len;
-  va_end(arg_list);
+  return false;
+}
+
+// 所有区间都超出文件范围，返回416并告知完整长度
+bool http_conn::add_range_not_satisfiable()
+{
+  add_status_line(416);
+  add_content_length(0);
+  add_response(http_headers::CONTENT_RANGE);
+  add_response("*/");
+  m_response.append_number(m_file_stat.st_size);
+  add_response(http_headers::CRLF);
+  add_linger();
+  add_blank_line();
+  m_response.end_response(m_linger);
   return true;
 }
 
@@ -1124,7 +2539,7 @@ bool http_conn::process_write(HTTP_CODE ret)
   switch (ret)
   {
   case INTERNAL_ERROR:
-    add_status_line(500, error_500_title);
+    add_status_line(500);
     add_headers(strlen(error_500_form));
     if (!add_content(error_500_form))
     {
@@ -1132,15 +2547,23 @@ bool http_conn::process_write(HTTP_CODE ret)
     }
     break;
   case BAD_REQUEST:
-    add_status_line(400, error_400_title);
+    add_status_line(400);
     add_headers(strlen(error_400_form));
     if (!add_content(error_400_form))
     {
       return false;
     }
     break;
+  case PAYLOAD_TOO_LARGE:
+    add_status_line(413);
+    add_headers(strlen(error_413_form));
+    if (!add_content(error_413_form))
+    {
+      return false;
+    }
+    break;
   case NO_RESOURCE:
-    add_status_line(404, error_404_title);
+    add_status_line(404);
     add_headers(strlen(error_404_form));
     if (!add_content(error_404_form))
     {
@@ -1148,31 +2571,83 @@ bool http_conn::process_write(HTTP_CODE ret)
     }
     break;
   case FORBIDDEN_REQUEST:
-    add_status_line(403, error_403_title);
+    add_status_line(403);
     add_headers(strlen(error_403_form));
     if (!add_content(error_403_form))
     {
       return false;
     }
     break;
+  case CREATED:
+    // PUT创建了新文件，Location指向它
+    add_status_line(201);
+    add_content_length(0);
+    add_response(http_headers::LOCATION);
+    add_response(m_url);
+    add_response(http_headers::CRLF);
+    add_linger();
+    add_blank_line();
+    break;
+  case NO_CONTENT:
+    add_status_line(204);
+    add_linger();
+    add_blank_line();
+    break;
+  case NOT_MODIFIED:
+    // 304不携带响应体，只返回校验器
+    add_status_line(304);
+    add_encoding_headers();
+    add_validators();
+    add_linger();
+    add_blank_line();
+    break;
   case FILE_REQUEST:
-    add_status_line(200, ok_200_title);
-    add_headers(m_file_stat.st_size);
-    m_iv[0].iov_base = m_write_buf;
-    m_iv[0].iov_len = m_write_idx;
-    m_iv[1].iov_base = m_file_address.get();
-    m_iv[1].iov_len = m_file_stat.st_size;
-    m_iv_count = 2;
-    bytes_to_send = m_write_idx + m_file_stat.st_size;
+    if (m_listing)
+    {
+      return add_listing_head();
+    }
+    if (m_archive)
+    {
+      return add_archive_head();
+    }
+    // 静态文件的GET请求支持Range，If-Range不匹配时按完整内容返回
+    if (m_method == GET && !m_dynamic_body && !m_range.empty() &&
+        (m_if_range.empty() || m_if_range == (m_if_range[0] == '"' ? m_etag : format_http_date(m_file_stat.st_mtime))))
+    {
+      std::vector<byte_range> ranges;
+      switch (parse_byte_ranges(m_range, m_file_stat.st_size, ranges))
+      {
+      case RANGE_OK:
+        return add_partial_content(ranges);
+      case RANGE_UNSATISFIABLE:
+        return add_range_not_satisfiable();
+      default:
+        break;
+      }
+    }
+
+    add_status_line(200);
+    if (!(m_method == HEAD && m_dynamic_body))
+    {
+      add_content_length(m_file_stat.st_size);
+    }
+    add_content_type();
+    add_encoding_headers();
+    if (!m_dynamic_body)
+    {
+      add_response(http_headers::ACCEPT_RANGES);
+    }
+    add_validators();
+    add_linger();
+    add_blank_line();
+    // 文件内容以零拷贝方式引用，响应构建器持有映射直到发送完成
+    add_body(0, m_file_stat.st_size);
+    m_response.end_response(m_linger);
     return true;
   default:
     return false;
   }
 
-  m_iv[0].iov_base = m_write_buf;
-  m_iv[0].iov_len = m_write_idx;
-  m_iv_count = 1;
-  bytes_to_send = m_write_idx;
-
+  m_response.end_response(m_linger);
   return true;
 }
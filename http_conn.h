@@ -12,16 +12,31 @@
 #include <arpa/inet.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
-#include <stdarg.h>
 #include <errno.h>
 #include <sys/uio.h>
 #include <string.h>
 #include <string>
+#include <string_view>
+#include <charconv>
 #include <memory>
 #include <map>
 #include <regex>
 #include <dirent.h>
 #include "locker.h"
+#include "http_headers.h"
+#include "response_buffer.h"
+#include "http_range.h"
+#include "compress_cache.h"
+#include "tls.h"
+#include "http2.h"
+#include "threadpool.h"
+#include "dir_listing.h"
+#include "upload_sink.h"
+#include "chunked_decoder.h"
+#include "archive_stream.h"
+#include "multipart_upload.h"
+#include "upload_layout.h"
+#include "meta_store.h"
 
 class http_conn
 {
@@ -29,15 +44,62 @@ public:
   // 使用std::string后不再需要固定长度的文件名
   // static const int FILENAME_LEN = 200; // 文件名的最大长度
 
-  static const int READ_BUFFER_SIZE = 2048;  // 读缓冲区的大小
-  static const int WRITE_BUFFER_SIZE = 1024; // 写缓冲区的大小
+  static const int READ_BUFFER_SIZE = 2048; // 读缓冲区的大小
+  static const int MAX_IOV = 64;            // 一次writev最多提交的内存块数量
+
+  // 不超过m_pread_max_size的文件pread到池化缓冲区，不超过POPULATE_MAX_SIZE的文件整体映射并MAP_POPULATE
+  // 更大的文件按窗口映射(file_window)
+  static const size_t POPULATE_MAX_SIZE = 256 * 1024;
+  static size_t m_pread_max_size; // 小文件阈值，启动时通过-p配置，0表示所有文件都映射
 
   // 上传文件相关常量
   static const std::string UPLOAD_DIR;               // 上传文件的目录路径
   static const int MAX_FILE_SIZE = 10 * 1024 * 1024; // 最大文件大小限制(10MB)
+  static const size_t LIST_PAGE_SIZE = 50;           // /api/files默认每页的文件数
+  static const size_t LIST_PAGE_MAX = 1000;          // /api/files每页最多的文件数
 
   static int m_epollfd;    // 所有socket上的事件都被注册到同一个epoll内核事件中，所以设置成静态的
   static int m_user_count; // 统计用户的数量
+  static int m_max_requests; // 每个连接最多处理的请求数，达到后响应带Connection: close，0表示不限制
+
+  /*
+      并发模型，启动时选择
+      PROACTOR:   主线程完成socket的读写，工作线程只负责解析请求和生成响应
+      REACTOR:    主线程只负责分发就绪事件，工作线程完成 读->解析->写 的整个过程
+  */
+  enum CONCURRENCY_MODEL
+  {
+    PROACTOR = 0,
+    REACTOR
+  };
+  static CONCURRENCY_MODEL m_model;
+
+  // 计算线程池负责解析请求和生成响应，磁盘I/O线程池负责所有可能阻塞的文件系统操作
+  // 磁盘I/O线程池为空时文件系统操作直接在计算线程中执行
+  static threadpool<http_conn> *m_compute_pool;
+  static threadpool<http_conn> *m_disk_pool;
+
+  /*
+      请求在两个线程池之间流转的阶段
+      PHASE_PARSE     :   在计算线程池中解析请求或生成响应
+      PHASE_DISK      :   已提交给磁盘I/O线程池，等待执行文件系统操作
+      PHASE_RESUME    :   文件系统操作完成，回到计算线程池根据结果生成响应
+      PHASE_BATCH     :   分批生成的响应体(文件列表、打包下载)的上一批已发送完，在磁盘I/O线程池中生成下一批
+  */
+  enum REQUEST_PHASE
+  {
+    PHASE_PARSE = 0,
+    PHASE_DISK,
+    PHASE_RESUME,
+    PHASE_BATCH
+  };
+
+  // Reactor模式下交给工作线程的就绪事件
+  enum IO_EVENT
+  {
+    EVENT_READ = 0,
+    EVENT_WRITE
+  };
 
   // HTTP请求方法
   enum METHOD
@@ -73,6 +135,9 @@ public:
       NO_RESOURCE         :   表示服务器没有资源
       FORBIDDEN_REQUEST   :   表示客户对资源没有足够的访问权限
       FILE_REQUEST        :   文件请求,获取文件成功
+      NOT_MODIFIED        :   条件请求命中，客户端缓存仍然有效，返回304
+      CREATED             :   PUT创建了新文件，返回201
+      NO_CONTENT          :   PUT覆盖了已有文件或DELETE删除成功，返回204
       INTERNAL_ERROR      :   表示服务器内部错误
       CLOSED_CONNECTION   :   表示客户端已经关闭连接了
   */
@@ -84,27 +149,41 @@ public:
     NO_RESOURCE,
     FORBIDDEN_REQUEST,
     FILE_REQUEST,
+    NOT_MODIFIED,
+    CREATED,
+    NO_CONTENT,
+    PAYLOAD_TOO_LARGE,
     INTERNAL_ERROR,
     CLOSED_CONNECTION
   };
 
-  http_conn() {}
+  http_conn() : m_sockfd(-1), m_ssl(NULL) {}
   ~http_conn()
   {
     close_conn();
   }
 
-  void init(int sockfd, const sockaddr_in &addr); // 初始化新接收的连接
-  void close_conn();                              // 关闭连接
-  bool read();                                    // 非阻塞的读
-  bool write();                                   // 非阻塞的写
-  void process();                                 // 处理客户端请求
+  void init(int sockfd, const sockaddr_in &addr, bool tls = false); // 初始化新接收的连接，tls表示来自HTTPS监听端口
+  void close_conn();                                                // 关闭连接
+  bool read();                                                      // 非阻塞的读
+  bool write();                                                     // 非阻塞的写
+  void process();                                                   // 由两个线程池的工作线程调用，根据所处阶段处理客户端请求
+  void set_io_event(IO_EVENT event) { m_io_event = event; }         // Reactor模式下记录就绪的事件
+  bool handshaking() const { return m_tls_handshaking; }            // TLS握手是否仍在进行，握手期间不交给工作线程
 
 private:
   int m_sockfd;                      // 该http连接的socket
+  SSL *m_ssl;                        // HTTPS连接的SSL对象，明文连接为NULL
+  bool m_tls_handshaking;            // TLS握手是否仍在进行
+  bool m_ktls_send;                  // 发送方向是否已交给内核TLS，是则可以直接writev明文
   sockaddr_in m_address;             // 通信的socket地址
   char m_read_buf[READ_BUFFER_SIZE]; // 读缓冲区
   int m_read_idx;                    // 标识读缓冲区中已经读入的客户端数据的最后一个字节的下一个位置
+  int64_t m_request_len;             // 当前请求(请求行+头部+请求体)在读缓冲区中占用的字节数，之后是流水线中的后续请求
+  int m_request_count;               // 该连接上已处理的请求数
+  IO_EVENT m_io_event;               // Reactor模式下工作线程要处理的事件
+  REQUEST_PHASE m_phase;             // 当前请求所处的阶段
+  int m_disk_ret;                    // 磁盘I/O线程得到的HTTP_CODE，回到计算线程后生成响应
 
   int m_checked_idx;         // 当前正在分析的字符在读缓冲区的位置
   int m_start_line;          // 当前正在解析的行的起始位置
@@ -115,52 +194,128 @@ private:
   std::string m_url;       // 请求目标文件的文件名
   std::string m_version;   // 协议版本，只支持http1.1
   std::string m_host;      // 主机名
-  int m_content_length;    // HTTP请求的消息总长度
+  int64_t m_content_length; // HTTP请求的消息总长度，头部不合法时为-1
   bool m_linger;           // 判断HTTP请求是否要保持连接
+  bool m_has_content_length; // 请求带有Content-Length头部
+  bool m_chunked_body;       // 请求体使用Transfer-Encoding: chunked
+  bool m_expect_continue;  // 请求带有Expect: 100-continue，客户端等待临时响应后才发送请求体
+  bool m_continue_sent;    // 已为当前请求发送过100 Continue
 
   // 文件上传相关成员
   std::string m_content_type;     // Content-Type头部的值
   std::string m_boundary;         // 多部分表单数据的分界线
-  std::string m_upload_file_name; // 上传的文件名
   bool m_is_upload_request;       // 是否是上传文件的请求
+  bool m_body_buffering;          // 上传表单的请求体不经过读缓冲区，整体读入m_body_buf
+  std::string m_body_buf;         // 上传表单的请求体，可能远大于读缓冲区，上限MAX_FILE_SIZE
+
+  std::string m_form_body; // application/x-www-form-urlencoded请求体，用于删除文件
+
+  // Range请求相关成员
+  std::string m_range;    // Range头部的值
+  std::string m_if_range; // If-Range头部的值
 
-  char m_write_buf[WRITE_BUFFER_SIZE]; // 写缓冲区
-  int m_write_idx;                     // 写缓冲区中待发送的字节数
+  // 条件请求相关成员
+  std::string m_if_none_match;     // If-None-Match头部的值
+  std::string m_if_modified_since; // If-Modified-Since头部的值
+  std::string m_etag;              // 实际发送内容的ETag
+
+  // 压缩协商相关成员
+  int m_accept_encoding;                              // 客户端可接受的压缩算法，ENCODING的按位组合
+  std::string_view m_content_encoding;                // 实际使用的压缩算法，为空表示未压缩
+  bool m_compressible;                                // 目标内容是否是可压缩的文本类型，需要发送Vary
+  std::string m_body_file;                            // 选中的预压缩文件路径
+  std::shared_ptr<const std::string> m_encoded_body;  // 命中的后台压缩缓存
+  bool m_dynamic_body;    // 响应体是否是动态生成的(如带文件列表的index.html)，动态内容不支持Range
+
+  response_buffer m_response; // 待发送的响应，头部拷贝进池化内存块，文件内容零拷贝引用
+  std::unique_ptr<dir_listing> m_listing; // 正在以chunked编码分批发送的文件列表，没有时为空
+  std::unique_ptr<upload_sink> m_upload;  // 正在流式写入的PUT请求体，没有时为空
+  std::unique_ptr<chunked_decoder> m_chunked; // 分块传输的请求体的解码状态，没有时为空
+  std::unique_ptr<archive_stream> m_archive;  // 正在分批发送的打包下载，没有时为空
+
+  // HTTP/2相关成员
+  std::unique_ptr<http2_session> m_h2; // 切换到HTTP/2后的会话，HTTP/1.1连接为空
+  bool m_upgrade_h2c;                  // 请求中带有Upgrade: h2c
+  std::string m_http2_settings;        // HTTP2-Settings头部的值
 
   // 使用智能指针替代裸指针，通过自定义删除器确保正确调用munmap
+  // 动态生成的页面(如带文件列表的index.html)也通过它引用内存中的响应体
   std::shared_ptr<char> m_file_address;
+  std::shared_ptr<file_window> m_file_window; // 大文件按窗口发送，为空时响应体在m_file_address中
   struct stat m_file_stat; // 目标文件的状态。通过它我们可以判断文件是否存在、是否为目录、是否可读，并获取文件大小等信息
-  struct iovec m_iv[2];    // 我们将采用writev来执行写操作，所以定义下面两个成员，其中m_iv_count表示被写内存块的数量。
-  int m_iv_count;
-
-  int bytes_to_send;   // 将要发送的数据的字节数
-  int bytes_have_send; // 已经发送的字节数
 
   void init();                                              // 初始化连接其余的信息
+  void reset_request();                                     // 重置与单个请求相关的信息
+  void consume_request();                                   // 丢弃已处理的请求，把流水线中剩余的字节移到读缓冲区开头
+  int process_request();                                    // 处理读缓冲区中的请求，返回接下来要等待的事件，连接已关闭时返回0
+  void dispatch(int event);                                 // 按process_request的返回值注册事件或直接发送
+  bool schedule_batch();                                    // 分批发送的响应体上一批已发送完，提交生成下一批的任务
+  int continue_batch();                                     // 生成并追加下一批，返回接下来要等待的事件
+  int continue_listing();                                   // 生成并追加文件列表的下一批
+  int continue_archive();                                   // 打开并追加打包下载的下一批成员
+  int finish_batch();                                       // 分批发送的响应体已全部生成，继续处理后面的请求
+  int tls_handshake();                                      // 推进TLS握手，返回1完成，0等待事件，-1失败
+  ssize_t recv_some(char *buf, size_t len);                 // 读取数据，TLS连接通过SSL_read解密
+  ssize_t send_iov(const struct iovec *iov, int iov_count); // 发送数据，未启用kTLS的TLS连接通过SSL_write加密
   HTTP_CODE process_read();                                 // 解析HTTP请求
   bool process_write(HTTP_CODE ret);                        // 填充HTTP应答
                                                             // 下面这一组函数被process_read调用以分析HTTP请求
   HTTP_CODE parse_request_line(const std::string &request); // 解析请求首行
   HTTP_CODE parse_headers(const std::string &request);      // 解析请求头
   HTTP_CODE parse_content(const std::string &request);      // 解析请求体
+  HTTP_CODE handle_request();                               // 请求中涉及文件系统的部分，在磁盘I/O线程中执行
+  bool parse_method(const std::string &method);             // 识别请求方法
+  void on_header(const std::string &name, const std::string &value); // 处理一个请求头部，名字大小写不敏感
+  void send_continue();                                              // 需要时追加100 Continue临时响应
+  HTTP_CODE handle_body(const std::string &body);           // 处理完整的请求体
+  bool read_body();                                         // 流式上传时把请求体直接读入上传缓冲区
+  size_t decode_upload(const char *data, size_t len);       // 把分块编码的原始字节解码到上传缓冲区
+  bool read_form_body();                                    // 把上传表单的请求体读入m_body_buf
+  size_t append_form_body(const char *data, size_t len);    // 追加(分块编码时解码)上传表单的请求体，返回消耗的字节数
+  HTTP_CODE form_body_status() const;                       // 上传表单的请求体是否已经收完
+  void keep_pipelined(const char *data, size_t len);        // 请求体之后多读到的字节放回读缓冲区
+  HTTP_CODE start_upload();                                 // PUT请求头解析完后准备接收请求体
+  HTTP_CODE continue_upload();                              // 把收到的请求体写入文件，全部写完后提交
+  HTTP_CODE delete_object();                                // 处理DELETE请求
+  HTTP_CODE start_archive();                                // 处理打包下载请求，确定成员和归档长度
+  HTTP_CODE list_files();                                   // 处理文件列表和搜索接口，生成JSON
   char *get_line() { return m_read_buf + m_start_line; }
   HTTP_CODE do_request();
 
+  // HTTP/2相关函数
+  bool is_h2_preface() const;
+  int process_h2();
+  int serve_streams();
+  bool process_upgrade(HTTP_CODE ret);
+  HTTP_CODE serve_stream(const header_list &headers, const std::string &body);
+  void finish_stream(HTTP_CODE ret);
+  void build_stream_response(HTTP_CODE ret, std::string &head, response_buffer &resp_body);
+
   // 文件上传相关函数
   HTTP_CODE handle_file_upload(const std::string &request_body);
-  std::map<std::string, std::string> parse_multipart_form_data(const std::string &request_body);
-  bool save_uploaded_file(const std::string &file_content, const std::string &file_name);
-  std::string generate_file_list_html();
 
   // 这一组函数被process_write调用以填充HTTP应答。
-  bool add_status_line(int status, const char *title);
-  void add_headers(int content_length);
-  bool add_content_length(int content_length);
+  bool add_status_line(int status);
+  void add_headers(int64_t content_length);
+  bool add_content_length(int64_t content_length);
+  void add_body(uint64_t offset, uint64_t len);
+  void add_chunk(const std::string &data);
+  bool add_listing_head();
+  bool add_archive_head();
   bool add_content_type();
+  std::string_view content_type_header(bool *attachment) const;
+  const http_headers::mime_entry *target_mime() const;
+  void select_encoding();
+  bool add_encoding_headers();
+  bool add_partial_content(const std::vector<byte_range> &ranges);
+  bool add_range_not_satisfiable();
+  bool add_validators();
+  std::string make_etag() const;
+  bool is_not_modified() const;
   bool add_linger();
   bool add_blank_line();
   bool add_content(const char *content);
-  bool add_response(const char *format, ...);
+  bool add_response(std::string_view data);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,202 @@
+#ifndef HTTP_HEADERS_H
+#define HTTP_HEADERS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string_view>
+
+// 编译期生成的HTTP响应头常量表
+// 状态行、常用头部和 扩展名->Content-Type 整行都在编译期拼好，
+// 组装响应时只需要按长度memcpy，不再经过vsnprintf格式化
+namespace http_headers
+{
+  // 状态行
+  constexpr std::string_view STATUS_100 = "HTTP/1.1 100 Continue\r\n\r\n";
+  constexpr std::string_view STATUS_101_H2C = "HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n";
+  constexpr std::string_view STATUS_200 = "HTTP/1.1 200 OK\r\n";
+  constexpr std::string_view STATUS_201 = "HTTP/1.1 201 Created\r\n";
+  constexpr std::string_view STATUS_204 = "HTTP/1.1 204 No Content\r\n";
+  constexpr std::string_view STATUS_206 = "HTTP/1.1 206 Partial Content\r\n";
+  constexpr std::string_view STATUS_304 = "HTTP/1.1 304 Not Modified\r\n";
+  constexpr std::string_view STATUS_400 = "HTTP/1.1 400 Bad Request\r\n";
+  constexpr std::string_view STATUS_403 = "HTTP/1.1 403 Forbidden\r\n";
+  constexpr std::string_view STATUS_404 = "HTTP/1.1 404 Not Found\r\n";
+  constexpr std::string_view STATUS_413 = "HTTP/1.1 413 Payload Too Large\r\n";
+  constexpr std::string_view STATUS_416 = "HTTP/1.1 416 Range Not Satisfiable\r\n";
+  constexpr std::string_view STATUS_500 = "HTTP/1.1 500 Internal Error\r\n";
+
+  constexpr std::string_view status_line(int status)
+  {
+    switch (status)
+    {
+    case 200:
+      return STATUS_200;
+    case 201:
+      return STATUS_201;
+    case 204:
+      return STATUS_204;
+    case 206:
+      return STATUS_206;
+    case 304:
+      return STATUS_304;
+    case 400:
+      return STATUS_400;
+    case 403:
+      return STATUS_403;
+    case 404:
+      return STATUS_404;
+    case 413:
+      return STATUS_413;
+    case 416:
+      return STATUS_416;
+    default:
+      return STATUS_500;
+    }
+  }
+
+  // 常用头部
+  constexpr std::string_view CONTENT_LENGTH = "Content-Length: ";
+  constexpr std::string_view CONNECTION_KEEP_ALIVE = "Connection: keep-alive\r\n";
+  constexpr std::string_view CONNECTION_CLOSE = "Connection: close\r\n";
+  constexpr std::string_view DISPOSITION_ATTACHMENT = "Content-Disposition: attachment; filename=\"";
+  constexpr std::string_view ACCEPT_RANGES = "Accept-Ranges: bytes\r\n";
+  constexpr std::string_view CONTENT_RANGE = "Content-Range: bytes ";
+  constexpr std::string_view MULTIPART_BYTERANGES = "Content-Type: multipart/byteranges; boundary=";
+  constexpr std::string_view ETAG = "ETag: ";
+  constexpr std::string_view LAST_MODIFIED = "Last-Modified: ";
+  constexpr std::string_view CACHE_REVALIDATE = "Cache-Control: no-cache\r\n";
+  constexpr std::string_view CACHE_NO_STORE = "Cache-Control: no-store\r\n";
+  constexpr std::string_view VARY_ENCODING = "Vary: Accept-Encoding\r\n";
+  constexpr std::string_view CONTENT_ENCODING = "Content-Encoding: ";
+  constexpr std::string_view LOCATION = "Location: ";
+  constexpr std::string_view TRANSFER_CHUNKED = "Transfer-Encoding: chunked\r\n";
+  constexpr std::string_view LAST_CHUNK = "0\r\n\r\n";
+  constexpr std::string_view CRLF = "\r\n";
+
+  // 没有扩展名或者扩展名未知时使用的Content-Type
+  constexpr std::string_view TYPE_HTML = "Content-Type: text/html\r\n";
+  constexpr std::string_view TYPE_TEXT = "Content-Type: text/plain; charset=UTF-8\r\n";
+  constexpr std::string_view TYPE_OCTET_STREAM = "Content-Type: application/octet-stream\r\n";
+  constexpr std::string_view TYPE_TAR = "Content-Type: application/x-tar\r\n";
+  constexpr std::string_view TYPE_JSON = "Content-Type: application/json\r\n";
+
+  struct mime_entry
+  {
+    std::string_view ext;    // 小写扩展名，不含'.'
+    std::string_view header; // 完整的Content-Type头部行
+    bool compressible;       // 是否是值得压缩的文本类型
+  };
+
+  constexpr mime_entry MIME_ENTRIES[] = {
+      {"html", "Content-Type: text/html; charset=UTF-8\r\n", true},
+      {"htm", "Content-Type: text/html; charset=UTF-8\r\n", true},
+      {"txt", "Content-Type: text/plain; charset=UTF-8\r\n", true},
+      {"jpg", "Content-Type: image/jpeg\r\n", false},
+      {"jpeg", "Content-Type: image/jpeg\r\n", false},
+      {"png", "Content-Type: image/png\r\n", false},
+      {"gif", "Content-Type: image/gif\r\n", false},
+      {"css", "Content-Type: text/css; charset=UTF-8\r\n", true},
+      {"js", "Content-Type: application/javascript; charset=UTF-8\r\n", true},
+      {"pdf", "Content-Type: application/pdf\r\n", false},
+      {"mp3", "Content-Type: audio/mpeg\r\n", false},
+      {"mp4", "Content-Type: video/mp4\r\n", false},
+  };
+  constexpr size_t MIME_COUNT = sizeof(MIME_ENTRIES) / sizeof(MIME_ENTRIES[0]);
+
+  // 哈希表槽位数，必须是2的幂
+  constexpr size_t MIME_TABLE_SIZE = 32;
+
+  constexpr char to_lower(char c)
+  {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+  }
+
+  // 大小写不敏感的带种子FNV-1a，查表时不需要先把扩展名转成小写
+  constexpr uint32_t mime_hash(std::string_view ext, uint32_t seed)
+  {
+    uint32_t h = 2166136261u ^ seed;
+    for (char c : ext)
+    {
+      h ^= static_cast<unsigned char>(to_lower(c));
+      h *= 16777619u;
+    }
+    return h ^ (h >> 15);
+  }
+
+  // 在编译期搜索一个让所有扩展名互不冲突的种子，得到完美哈希
+  constexpr uint32_t find_mime_seed()
+  {
+    for (uint32_t seed = 1; seed < 100000; ++seed)
+    {
+      bool used[MIME_TABLE_SIZE] = {};
+      bool ok = true;
+      for (size_t i = 0; i < MIME_COUNT && ok; ++i)
+      {
+        size_t slot = mime_hash(MIME_ENTRIES[i].ext, seed) & (MIME_TABLE_SIZE - 1);
+        ok = !used[slot];
+        used[slot] = true;
+      }
+      if (ok)
+      {
+        return seed;
+      }
+    }
+    return 0;
+  }
+
+  constexpr uint32_t MIME_SEED = find_mime_seed();
+  static_assert(MIME_SEED != 0, "no perfect hash seed for MIME table");
+
+  struct mime_table
+  {
+    int8_t slots[MIME_TABLE_SIZE];
+  };
+
+  constexpr mime_table build_mime_table()
+  {
+    mime_table table{};
+    for (size_t i = 0; i < MIME_TABLE_SIZE; ++i)
+    {
+      table.slots[i] = -1;
+    }
+    for (size_t i = 0; i < MIME_COUNT; ++i)
+    {
+      table.slots[mime_hash(MIME_ENTRIES[i].ext, MIME_SEED) & (MIME_TABLE_SIZE - 1)] = static_cast<int8_t>(i);
+    }
+    return table;
+  }
+
+  constexpr mime_table MIME_TABLE = build_mime_table();
+
+  constexpr bool ext_equal(std::string_view lower, std::string_view ext)
+  {
+    if (lower.size() != ext.size())
+    {
+      return false;
+    }
+    for (size_t i = 0; i < ext.size(); ++i)
+    {
+      if (lower[i] != to_lower(ext[i]))
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // 根据扩展名(不含'.'，大小写不敏感)查找Content-Type头部行，未知扩展名返回nullptr
+  constexpr const mime_entry *lookup_mime(std::string_view ext)
+  {
+    int8_t idx = MIME_TABLE.slots[mime_hash(ext, MIME_SEED) & (MIME_TABLE_SIZE - 1)];
+    if (idx < 0 || !ext_equal(MIME_ENTRIES[idx].ext, ext))
+    {
+      return nullptr;
+    }
+    return &MIME_ENTRIES[idx];
+  }
+
+  static_assert(lookup_mime("HTML") == &MIME_ENTRIES[0], "MIME lookup must be case-insensitive");
+  static_assert(lookup_mime("exe") == nullptr, "unknown extension must miss");
+}
+
+#endif
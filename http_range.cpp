@@ -0,0 +1,131 @@
+#include "http_range.h"
+#include <charconv>
+#include <algorithm>
+#include <strings.h>
+
+static std::string_view trim(std::string_view s)
+{
+  while (!s.empty() && (s.front() == ' ' || s.front() == '\t'))
+  {
+    s.remove_prefix(1);
+  }
+  while (!s.empty() && (s.back() == ' ' || s.back() == '\t'))
+  {
+    s.remove_suffix(1);
+  }
+  return s;
+}
+
+// 解析非负十进制整数，不允许空串和多余字符
+static bool parse_offset(std::string_view s, int64_t &value)
+{
+  if (s.empty())
+  {
+    return false;
+  }
+  auto res = std::from_chars(s.data(), s.data() + s.size(), value);
+  return res.ec == std::errc() && res.ptr == s.data() + s.size() && value >= 0;
+}
+
+RANGE_RESULT parse_byte_ranges(std::string_view header, int64_t size, std::vector<byte_range> &ranges)
+{
+  ranges.clear();
+
+  header = trim(header);
+  if (header.size() < 6 || strncasecmp(header.data(), "bytes=", 6) != 0)
+  {
+    return RANGE_NONE;
+  }
+  header.remove_prefix(6);
+
+  size_t spec_count = 0;
+  while (!header.empty())
+  {
+    size_t comma = header.find(',');
+    std::string_view spec = trim(header.substr(0, comma));
+    header = comma == std::string_view::npos ? std::string_view() : header.substr(comma + 1);
+
+    if (spec.empty())
+    {
+      continue;
+    }
+    if (++spec_count > MAX_BYTE_RANGES)
+    {
+      return RANGE_NONE;
+    }
+
+    size_t dash = spec.find('-');
+    if (dash == std::string_view::npos)
+    {
+      return RANGE_NONE;
+    }
+
+    int64_t first = 0;
+    int64_t last = 0;
+    if (dash == 0)
+    {
+      // "-n"：最后n个字节
+      if (!parse_offset(spec.substr(1), last))
+      {
+        return RANGE_NONE;
+      }
+      if (last == 0 || size == 0)
+      {
+        continue;
+      }
+      first = last >= size ? 0 : size - last;
+      last = size - 1;
+    }
+    else
+    {
+      if (!parse_offset(spec.substr(0, dash), first))
+      {
+        return RANGE_NONE;
+      }
+      std::string_view last_str = spec.substr(dash + 1);
+      if (last_str.empty())
+      {
+        // "a-"：从a到文件末尾
+        last = size - 1;
+      }
+      else if (!parse_offset(last_str, last) || last < first)
+      {
+        return RANGE_NONE;
+      }
+      if (first >= size)
+      {
+        continue;
+      }
+      last = std::min(last, size - 1);
+    }
+    ranges.push_back({first, last});
+  }
+
+  if (spec_count == 0)
+  {
+    return RANGE_NONE;
+  }
+  if (ranges.empty())
+  {
+    return RANGE_UNSATISFIABLE;
+  }
+
+  // 排序后合并重叠或相邻的区间
+  std::sort(ranges.begin(), ranges.end(), [](const byte_range &a, const byte_range &b)
+            { return a.first < b.first; });
+  size_t merged = 0;
+  for (size_t i = 1; i < ranges.size(); ++i)
+  {
+    if (ranges[i].first <= ranges[merged].last + 1)
+    {
+      ranges[merged].last = std::max(ranges[merged].last, ranges[i].last);
+    }
+    else
+    {
+      ranges[++merged] = ranges[i];
+    }
+  }
+  ranges.resize(merged + 1);
+
+  return RANGE_OK;
+}
@@ -0,0 +1,36 @@
+#ifndef HTTP_RANGE_H
+#define HTTP_RANGE_H
+
+#include <stdint.h>
+#include <string_view>
+#include <vector>
+
+// Range请求中的一个字节区间，first和last都包含在内
+struct byte_range
+{
+  int64_t first;
+  int64_t last;
+
+  int64_t length() const { return last - first + 1; }
+};
+
+/*
+    Range头部的解析结果
+    RANGE_NONE          :   没有Range头部，或者语法不正确/区间过多，按完整内容返回200
+    RANGE_OK            :   至少有一个可以满足的区间，返回206
+    RANGE_UNSATISFIABLE :   所有区间都超出了文件范围，返回416
+*/
+enum RANGE_RESULT
+{
+  RANGE_NONE,
+  RANGE_OK,
+  RANGE_UNSATISFIABLE
+};
+
+// 一个请求最多接受的区间数量，防止大量细碎区间放大响应
+const size_t MAX_BYTE_RANGES = 16;
+
+// 解析"bytes=a-b, c-, -n"形式的Range头部，重叠或相邻的区间会被合并
+RANGE_RESULT parse_byte_ranges(std::string_view header, int64_t size, std::vector<byte_range> &ranges);
+
+#endif
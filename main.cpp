@@ -10,55 +10,165 @@
 #include "locker.h"
 #include "threadpool.h"
 #include "http_conn.h"
+#include "multipart_upload.h"
+#include "content_store.h"
+#include "meta_store.h"
 #include "util.h"
+#include "tls.h"
 
 #define MAX_FD 65535        // 最大的文件描述符个数
 #define MAX_EVENT_NUM 10000 // 监听的最大的事件数量
+#define STATS_INTERVAL 10   // 输出线程池统计的间隔(秒)
+
+// 创建监听指定端口的套接字
+static int create_listenfd(int port)
+{
+  int listenfd = socket(PF_INET, SOCK_STREAM, 0);
+
+  // 设置端口复用
+  int reuse = 1;
+  setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+  // 绑定
+  struct sockaddr_in address;
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = INADDR_ANY;
+  address.sin_port = htons(port);
+  bind(listenfd, (struct sockaddr *)&address, sizeof(address));
+
+  // 监听
+  listen(listenfd, 16);
+  return listenfd;
+}
+
+// 输出线程池的队列深度，两次之间没有新任务时不输出
+static void print_pool_stats(const char *name, threadpool<http_conn> *pool, uint64_t &last_completed)
+{
+  if (!pool)
+  {
+    return;
+  }
+  pool_stats s = pool->stats();
+  if (s.completed != last_completed)
+  {
+    printf("%s线程池: 队列深度 %zu, 峰值 %zu, 累计任务 %lu\n", name, s.depth, s.peak_depth, (unsigned long)s.completed);
+    last_completed = s.completed;
+  }
+}
+
+static void usage(const char *prog)
+{
+  printf("按照如下格式运行：%s port_number [-s https_port -c cert.pem -k key.pem] [-n max_requests] [-m proactor|reactor] [-t threads] [-d disk_threads] [-p pread_max_size]\n", prog);
+}
 
 int main(int argc, char *argv[])
 {
   if (argc <= 1)
   {
-    printf("按照如下格式允许：%s port_number\n", basename(argv[0]));
+    usage(basename(argv[0]));
     exit(-1);
   }
 
   // 获取端口号
   int port = atoi(argv[1]);
 
+  // 可选的HTTPS监听端口、证书和私钥
+  int https_port = 0;
+  const char *cert_file = NULL;
+  const char *key_file = NULL;
+  int compute_threads = 8; // 计算线程数
+  int disk_threads = 4;    // 磁盘I/O线程数，0表示文件系统操作在计算线程中执行
+  int opt;
+  while ((opt = getopt(argc, argv, "s:c:k:n:m:t:d:p:")) != -1)
+  {
+    switch (opt)
+    {
+    case 's':
+      https_port = atoi(optarg);
+      break;
+    case 'c':
+      cert_file = optarg;
+      break;
+    case 'k':
+      key_file = optarg;
+      break;
+    case 'n':
+      // 每个连接最多处理的请求数，0表示不限制
+      http_conn::m_max_requests = atoi(optarg);
+      break;
+    case 'm':
+      // 并发模型
+      if (strcmp(optarg, "reactor") == 0)
+      {
+        http_conn::m_model = http_conn::REACTOR;
+      }
+      else if (strcmp(optarg, "proactor") != 0)
+      {
+        usage(basename(argv[0]));
+        exit(-1);
+      }
+      break;
+    case 't':
+      compute_threads = atoi(optarg);
+      break;
+    case 'd':
+      disk_threads = atoi(optarg);
+      break;
+    case 'p':
+      // 不超过该大小(字节)的文件pread到缓冲区发送，更大的文件使用映射
+      http_conn::m_pread_max_size = strtoul(optarg, NULL, 10);
+      break;
+    default:
+      usage(basename(argv[0]));
+      exit(-1);
+    }
+  }
+
+  if (https_port > 0 && (!cert_file || !key_file || !tls_init(cert_file, key_file)))
+  {
+    printf("HTTPS需要有效的证书(-c)和私钥(-k)\n");
+    exit(-1);
+  }
+
+  printf("并发模型: %s\n", http_conn::m_model == http_conn::REACTOR ? "Reactor" : "Proactor");
+  file_buffer_pool::instance().set_buffer_size(http_conn::m_pread_max_size);
+  content_store::instance().load(http_conn::UPLOAD_DIR);
+  if (!meta_store::instance().open(http_conn::UPLOAD_DIR))
+  {
+    // 继续运行的话，之后的上传和删除都不会写入日志，重启后丢失
+    printf("打开上传文件的元数据失败\n");
+    exit(-1);
+  }
+
   // 对sigpipe信号进行处理
   addsig(SIGPIPE, SIG_IGN);
 
-  // 初始化线程池
+  // 初始化计算线程池和磁盘I/O线程池
   threadpool<http_conn> *pool = NULL;
+  threadpool<http_conn> *disk_pool = NULL;
   try
   {
-    pool = new threadpool<http_conn>;
+    pool = new threadpool<http_conn>(compute_threads);
+    if (disk_threads > 0)
+    {
+      disk_pool = new threadpool<http_conn>(disk_threads);
+      // 一次上传多个文件时，各文件由上传写入线程池并行写盘
+      upload_batch::m_pool = new threadpool<upload_write_task>(disk_threads);
+    }
   }
   catch (...)
   {
     exit(-1);
   }
+  http_conn::m_compute_pool = pool;
+  http_conn::m_disk_pool = disk_pool;
 
   // 创建一个数组用于保存所有的客户端信息
   http_conn *users = new http_conn[MAX_FD];
 
-  // 创建监听的套接字
-  int listenfd = socket(PF_INET, SOCK_STREAM, 0);
-
-  // 设置端口复用
-  int reuse = 1;
-  setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
-
-  // 绑定
-  struct sockaddr_in address;
-  address.sin_family = AF_INET;
-  address.sin_addr.s_addr = INADDR_ANY;
-  address.sin_port = htons(port);
-  bind(listenfd, (struct sockaddr *)&address, sizeof(address));
-
-  // 监听
-  listen(listenfd, 16);
+  // 创建监听的套接字，配置了HTTPS时再创建一个TLS监听套接字
+  int listenfd = create_listenfd(port);
+  int tls_listenfd = https_port > 0 ? create_listenfd(https_port) : -1;
 
   // 创建epoll对象，事件数组，添加
   epoll_event events[MAX_EVENT_NUM];
@@ -66,27 +176,46 @@ int main(int argc, char *argv[])
 
   // 将监听的文件描述符到epoll对象中
   addfd(epollfd, listenfd, false);
+  if (tls_listenfd != -1)
+  {
+    addfd(epollfd, tls_listenfd, false);
+  }
   http_conn::m_epollfd = epollfd;
 
+  time_t last_stats = time(NULL);
+  uint64_t compute_completed = 0, disk_completed = 0;
   while (true)
   {
-    int num = epoll_wait(epollfd, events, MAX_EVENT_NUM, -1);
+    int num = epoll_wait(epollfd, events, MAX_EVENT_NUM, STATS_INTERVAL * 1000);
     if ((num < 0) && (errno != EINTR))
     {
       printf("epoll failure: %s (errno=%d)\n", strerror(errno), errno);
       break;
     }
 
+    // 定期输出两个线程池的队列深度
+    time_t now = time(NULL);
+    if (now - last_stats >= STATS_INTERVAL)
+    {
+      print_pool_stats("计算", pool, compute_completed);
+      print_pool_stats("磁盘I/O", disk_pool, disk_completed);
+      last_stats = now;
+    }
+
     // 循环遍历事件数组
     for (int i = 0; i < num; i++)
     {
       int sockfd = events[i].data.fd;
-      if (sockfd == listenfd)
+      if (sockfd == listenfd || sockfd == tls_listenfd)
       {
         // 有客户端连接
         struct sockaddr_in client_address;
         socklen_t client_addrlen = sizeof(client_address);
-        int connfd = accept(listenfd, (struct sockaddr *)&client_address, &client_addrlen);
+        int connfd = accept(sockfd, (struct sockaddr *)&client_address, &client_addrlen);
+        if (connfd < 0)
+        {
+          continue;
+        }
 
         if (http_conn::m_user_count >= MAX_FD)
         {
@@ -96,19 +225,28 @@ int main(int argc, char *argv[])
           continue;
         }
         // 将新的客户数据初始化加入数组
-        users[connfd].init(connfd, client_address);
+        users[connfd].init(connfd, client_address, sockfd == tls_listenfd);
       }
       else if (events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR))
       {
         // 对方异常断开或者错误事件
         users[sockfd].close_conn();
       }
+      else if (http_conn::m_model == http_conn::REACTOR)
+      {
+        // Reactor模式：只记录就绪的事件，读写都交给工作线程
+        users[sockfd].set_io_event((events[i].events & EPOLLIN) ? http_conn::EVENT_READ : http_conn::EVENT_WRITE);
+        pool->append(users + sockfd);
+      }
       else if (events[i].events & EPOLLIN)
       {
         if (users[sockfd].read())
         {
-          // 一次性读完所有数据
-          pool->append(users + sockfd);
+          // 一次性读完所有数据，TLS握手期间不需要交给工作线程
+          if (!users[sockfd].handshaking())
+          {
+            pool->append(users + sockfd);
+          }
         }
         else
         {
@@ -127,8 +265,14 @@ int main(int argc, char *argv[])
 
   close(epollfd);
   close(listenfd);
+  if (tls_listenfd != -1)
+  {
+    close(tls_listenfd);
+  }
   delete[] users;
   delete pool;
+  delete disk_pool;
+  delete upload_batch::m_pool;
 
   return 0;
 }
\ No newline at end of file
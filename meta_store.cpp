@@ -0,0 +1,594 @@
+#include "meta_store.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <zlib.h>
+#include "content_store.h"
+#include "upload_layout.h"
+
+// 记录格式：u32 CRC(负载) | u32 负载长度 | 负载
+// PUT负载：u8 类型 | u64 大小 | i64 上传时间 | 文件名 | 描述 | 哈希 | Content-Type，字符串都是u32长度加内容
+// DELETE负载：u8 类型 | 文件名
+// 数字按本机字节序保存，快照和日志只在同一台机器上使用
+static const size_t HEADER_SIZE = 8;
+
+static void put_u32(std::string &out, uint32_t v)
+{
+  out.append(reinterpret_cast<const char *>(&v), sizeof(v));
+}
+
+static void put_u64(std::string &out, uint64_t v)
+{
+  out.append(reinterpret_cast<const char *>(&v), sizeof(v));
+}
+
+static void put_string(std::string &out, const std::string &s)
+{
+  put_u32(out, s.size());
+  out.append(s);
+}
+
+// 从负载中依次读取字段，越界时ok变为false
+struct record_reader
+{
+  const char *p;
+  const char *end;
+  bool ok;
+
+  template <typename T>
+  T number()
+  {
+    T v = 0;
+    if (end - p < (ptrdiff_t)sizeof(T))
+    {
+      ok = false;
+      return v;
+    }
+    memcpy(&v, p, sizeof(T));
+    p += sizeof(T);
+    return v;
+  }
+
+  std::string string()
+  {
+    uint32_t len = number<uint32_t>();
+    if (!ok || (size_t)(end - p) < len)
+    {
+      ok = false;
+      return std::string();
+    }
+    std::string s(p, len);
+    p += len;
+    return s;
+  }
+};
+
+// 为负载加上CRC和长度
+static void seal(std::string &record)
+{
+  uint32_t len = record.size() - HEADER_SIZE;
+  uint32_t crc = crc32(0, reinterpret_cast<const Bytef *>(record.data() + HEADER_SIZE), len);
+  memcpy(&record[0], &crc, 4);
+  memcpy(&record[4], &len, 4);
+}
+
+meta_store &meta_store::instance()
+{
+  static meta_store store;
+  return store;
+}
+
+void meta_store::encode_put(const std::string &name, const file_meta &meta, std::string &out)
+{
+  std::string record(HEADER_SIZE, '\0');
+  record += (char)RECORD_PUT;
+  put_u64(record, meta.size);
+  put_u64(record, (uint64_t)meta.upload_time);
+  put_string(record, name);
+  put_string(record, meta.description);
+  put_string(record, meta.hash);
+  put_string(record, meta.content_type);
+  seal(record);
+  out += record;
+}
+
+void meta_store::encode_delete(const std::string &name, std::string &out)
+{
+  std::string record(HEADER_SIZE, '\0');
+  record += (char)RECORD_DELETE;
+  put_string(record, name);
+  seal(record);
+  out += record;
+}
+
+size_t meta_store::replay(const char *data, size_t len)
+{
+  size_t pos = 0;
+  while (len - pos >= HEADER_SIZE)
+  {
+    uint32_t crc, size;
+    memcpy(&crc, data + pos, 4);
+    memcpy(&size, data + pos + 4, 4);
+    const char *payload = data + pos + HEADER_SIZE;
+    if (size == 0 || len - pos - HEADER_SIZE < size ||
+        crc32(0, reinterpret_cast<const Bytef *>(payload), size) != crc)
+    {
+      // 写了一半或损坏的记录，之后的内容都不可信
+      break;
+    }
+
+    record_reader r = {payload + 1, payload + size, true};
+    if (payload[0] == RECORD_PUT)
+    {
+      file_meta meta;
+      meta.size = r.number<uint64_t>();
+      meta.upload_time = (int64_t)r.number<uint64_t>();
+      std::string name = r.string();
+      meta.description = r.string();
+      meta.hash = r.string();
+      meta.content_type = r.string();
+      if (!r.ok)
+      {
+        break;
+      }
+      m_index[name] = std::move(meta);
+    }
+    else if (payload[0] == RECORD_DELETE)
+    {
+      std::string name = r.string();
+      if (!r.ok)
+      {
+        break;
+      }
+      m_index.erase(name);
+    }
+    else
+    {
+      break;
+    }
+    pos += HEADER_SIZE + size;
+  }
+  return pos;
+}
+
+// 映射整个文件并重放其中的记录，文件不存在时视为空文件
+bool meta_store::load_file(const std::string &path, uint64_t &valid_bytes, uint64_t &file_bytes)
+{
+  valid_bytes = file_bytes = 0;
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    return errno == ENOENT;
+  }
+  struct stat st;
+  if (fstat(fd, &st) < 0)
+  {
+    close(fd);
+    return false;
+  }
+  file_bytes = st.st_size;
+  if (file_bytes > 0)
+  {
+    void *data = mmap(NULL, file_bytes, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    if (data == MAP_FAILED)
+    {
+      close(fd);
+      return false;
+    }
+    valid_bytes = replay(static_cast<const char *>(data), file_bytes);
+    munmap(data, file_bytes);
+  }
+  close(fd);
+  return true;
+}
+
+bool meta_store::open(const std::string &dir)
+{
+  m_lock.lock();
+  m_meta_dir = dir + "/.meta";
+  // 没有快照并且日志为空时是第一次启动；导入失败时还没有快照，下次启动会重新导入
+  bool first_run = access((m_meta_dir + "/snapshot").c_str(), F_OK) != 0;
+  if (mkdir(m_meta_dir.c_str(), 0755) < 0 && errno != EEXIST)
+  {
+    printf("创建元数据目录失败: %s\n", strerror(errno));
+    m_lock.unlock();
+    return false;
+  }
+
+  uint64_t valid, total;
+  if (!load_file(m_meta_dir + "/snapshot", valid, total))
+  {
+    printf("读取元数据快照失败: %s\n", strerror(errno));
+    m_lock.unlock();
+    return false;
+  }
+  m_snapshot_bytes = valid;
+  if (!load_file(m_meta_dir + "/log", valid, total))
+  {
+    printf("读取元数据日志失败: %s\n", strerror(errno));
+    m_lock.unlock();
+    return false;
+  }
+
+  m_log_fd = ::open((m_meta_dir + "/log").c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+  if (m_log_fd < 0)
+  {
+    printf("打开元数据日志失败: %s\n", strerror(errno));
+    m_lock.unlock();
+    return false;
+  }
+  if (valid < total)
+  {
+    // 丢弃末尾不完整的记录，之后的记录从有效部分之后追加
+    printf("元数据日志末尾有 %llu 字节不完整的记录，已丢弃\n", (unsigned long long)(total - valid));
+    if (ftruncate(m_log_fd, valid) < 0)
+    {
+      printf("截断元数据日志失败: %s\n", strerror(errno));
+    }
+  }
+  m_log_bytes = valid;
+  first_run = first_run && total == 0;
+  m_lock.unlock();
+
+  // 导入后写快照时会自己加锁
+  if (first_run && !import_legacy(dir))
+  {
+    return false;
+  }
+
+  m_lock.lock();
+  std::vector<std::string> all;
+  all.reserve(m_index.size());
+  for (const auto &entry : m_index)
+  {
+    all.push_back(entry.first);
+  }
+  m_files.build(std::move(all));
+  m_epoch = m_changed = time(NULL);
+  printf("元数据: %zu 个文件\n", m_index.size());
+  m_lock.unlock();
+  return true;
+}
+
+// 从旧版本的上传目录导入：文件大小和修改时间来自stat，描述来自.desc_文件，之后写成第一个快照
+// 快照写入成功后才删除描述文件，失败时返回false，上传目录保持原样
+bool meta_store::import_legacy(const std::string &dir)
+{
+  upload_walker walker(dir);
+  std::string name, path;
+  std::vector<std::string> desc_files;
+  std::unordered_map<std::string, file_meta> imported;
+  while (walker.next(name, path))
+  {
+    struct stat st;
+    if (stat(path.c_str(), &st) < 0 || !S_ISREG(st.st_mode))
+    {
+      continue;
+    }
+    file_meta meta;
+    meta.size = st.st_size;
+    meta.upload_time = st.st_mtime;
+    content_store::instance().lookup(st, meta.hash);
+
+    std::string desc_path = upload_layout::desc_path(dir, name);
+    FILE *fp = fopen(desc_path.c_str(), "r");
+    if (fp)
+    {
+      char buf[4096];
+      size_t n;
+      while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+      {
+        meta.description.append(buf, n);
+      }
+      fclose(fp);
+      desc_files.push_back(desc_path);
+    }
+    imported[name] = std::move(meta);
+  }
+
+  size_t files = imported.size();
+  m_lock.lock();
+  m_index = std::move(imported);
+  m_lock.unlock();
+  if (!compact())
+  {
+    return false;
+  }
+  for (const std::string &desc_path : desc_files)
+  {
+    unlink(desc_path.c_str());
+  }
+  printf("元数据: 从上传目录导入 %zu 个文件，%zu 个描述\n", files, desc_files.size());
+  return true;
+}
+
+// 追加一条记录，返回true表示日志已经过大，调用者释放锁之后应当调用compact。调用者持有锁
+bool meta_store::append(const std::string &record)
+{
+  if (m_log_fd < 0)
+  {
+    return false;
+  }
+  size_t done = 0;
+  while (done < record.size())
+  {
+    ssize_t n = ::write(m_log_fd, record.data() + done, record.size() - done);
+    if (n < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if (n <= 0)
+    {
+      printf("写入元数据日志失败: %s\n", strerror(errno));
+      return false;
+    }
+    done += n;
+  }
+  m_log_bytes += record.size();
+
+  if (m_compacting)
+  {
+    // 正在写的快照不包含这条记录，替换日志时要保留
+    m_compact_tail += record;
+    return false;
+  }
+  if (m_log_bytes >= COMPACT_MIN_BYTES && m_log_bytes > m_snapshot_bytes)
+  {
+    m_compacting = true;
+    return true;
+  }
+  return false;
+}
+
+static bool write_all(int fd, const std::string &data)
+{
+  size_t done = 0;
+  while (done < data.size())
+  {
+    ssize_t n = ::write(fd, data.data() + done, data.size() - done);
+    if (n < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if (n <= 0)
+    {
+      return false;
+    }
+    done += n;
+  }
+  return true;
+}
+
+// 让目录中的rename持久化
+static bool sync_dir(const std::string &dir)
+{
+  int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+  if (fd < 0)
+  {
+    return false;
+  }
+  bool ok = fsync(fd) == 0;
+  close(fd);
+  return ok;
+}
+
+// 把当前所有属性写成新的快照，然后从日志中去掉快照已经包含的部分
+// 只在编码快照和替换日志时持有锁，写入快照和fsync期间其他线程可以继续修改，新的记录照常追加到日志。
+// 新快照替换之后、日志处理之前崩溃时，在新快照上重放整个日志得到的结果相同。
+// 失败时返回false，旧快照和日志保持不变。调用者不持有锁
+bool meta_store::compact()
+{
+  std::string data;
+  m_lock.lock();
+  m_compacting = true;
+  m_compact_tail.clear();
+  for (const auto &entry : m_index)
+  {
+    encode_put(entry.first, entry.second, data);
+  }
+  m_lock.unlock();
+
+  bool ok = write_snapshot(data);
+
+  m_lock.lock();
+  if (ok)
+  {
+    m_snapshot_bytes = data.size();
+    ok = drop_compacted_log();
+  }
+  m_compacting = false;
+  m_compact_tail.clear();
+  m_lock.unlock();
+  return ok;
+}
+
+// 先写临时文件并fdatasync，rename替换旧快照后fsync目录，日志只在新快照持久化之后才处理。不需要持有锁
+bool meta_store::write_snapshot(const std::string &data)
+{
+  std::string temp = m_meta_dir + "/snapshot.tmp";
+  int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+  {
+    printf("创建元数据快照失败: %s\n", strerror(errno));
+    return false;
+  }
+  bool ok = write_all(fd, data) && fdatasync(fd) == 0;
+  close(fd);
+  if (!ok || rename(temp.c_str(), (m_meta_dir + "/snapshot").c_str()) < 0)
+  {
+    printf("写入元数据快照失败: %s\n", strerror(errno));
+    unlink(temp.c_str());
+    return false;
+  }
+  if (!sync_dir(m_meta_dir))
+  {
+    printf("同步元数据目录失败: %s\n", strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+// 写快照期间没有新记录时直接清空日志，否则用只包含这些记录的新日志替换旧日志。调用者持有锁
+bool meta_store::drop_compacted_log()
+{
+  if (m_log_fd < 0)
+  {
+    return false;
+  }
+  if (m_compact_tail.empty())
+  {
+    if (ftruncate(m_log_fd, 0) < 0)
+    {
+      printf("清空元数据日志失败: %s\n", strerror(errno));
+      return false;
+    }
+    m_log_bytes = 0;
+    return true;
+  }
+
+  std::string temp = m_meta_dir + "/log.tmp";
+  int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+  if (fd < 0 || !write_all(fd, m_compact_tail) || fdatasync(fd) < 0 ||
+      rename(temp.c_str(), (m_meta_dir + "/log").c_str()) < 0)
+  {
+    printf("替换元数据日志失败: %s\n", strerror(errno));
+    if (fd >= 0)
+    {
+      close(fd);
+    }
+    unlink(temp.c_str());
+    return false;
+  }
+  // 之后的记录追加到新日志
+  close(m_log_fd);
+  m_log_fd = fd;
+  m_log_bytes = m_compact_tail.size();
+  sync_dir(m_meta_dir);
+  return true;
+}
+
+void meta_store::put(const std::string &name, file_meta meta)
+{
+  m_lock.lock();
+  auto it = m_index.find(name);
+  if (it == m_index.end())
+  {
+    m_files.insert(name);
+  }
+  else if (meta.description.empty())
+  {
+    meta.description = it->second.description;
+  }
+  std::string record;
+  encode_put(name, meta, record);
+  m_index[name] = std::move(meta);
+  bool full = append(record);
+  touch();
+  m_lock.unlock();
+  if (full)
+  {
+    compact();
+  }
+}
+
+void meta_store::remove(const std::string &name)
+{
+  m_lock.lock();
+  bool full = false;
+  if (m_index.erase(name) > 0)
+  {
+    std::string record;
+    encode_delete(name, record);
+    full = append(record);
+    m_files.erase(name);
+    touch();
+  }
+  m_lock.unlock();
+  if (full)
+  {
+    compact();
+  }
+}
+
+bool meta_store::get(const std::string &name, file_meta &meta)
+{
+  m_lock.lock();
+  auto it = m_index.find(name);
+  bool found = it != m_index.end();
+  if (found)
+  {
+    meta = it->second;
+  }
+  m_lock.unlock();
+  return found;
+}
+
+void meta_store::list_after(const std::string &after, size_t limit, std::vector<std::pair<std::string, file_meta>> &page)
+{
+  std::vector<std::string> names;
+  m_lock.lock();
+  m_files.list_after(after, limit, names);
+  page.clear();
+  page.reserve(names.size());
+  for (std::string &name : names)
+  {
+    auto it = m_index.find(name);
+    page.emplace_back(std::move(name), it->second);
+  }
+  m_lock.unlock();
+}
+
+size_t meta_store::size()
+{
+  m_lock.lock();
+  size_t n = m_index.size();
+  m_lock.unlock();
+  return n;
+}
+
+// 记录一次修改，调用者持有锁
+void meta_store::touch()
+{
+  m_generation++;
+  m_changed = time(NULL);
+}
+
+std::string meta_store::version_locked() const
+{
+  char buf[48];
+  snprintf(buf, sizeof(buf), "%llx-%llx", (unsigned long long)m_epoch, (unsigned long long)m_generation);
+  return buf;
+}
+
+std::string meta_store::version(int64_t &changed)
+{
+  m_lock.lock();
+  std::string v = version_locked();
+  changed = m_changed;
+  m_lock.unlock();
+  return v;
+}
+
+size_t meta_store::search(const std::string &query, size_t offset, size_t limit,
+                          std::vector<std::pair<std::string, file_meta>> &page, std::string &version, int64_t &changed)
+{
+  std::vector<std::string> names;
+  m_lock.lock();
+  size_t total = m_files.search(query, offset, limit, names);
+  page.clear();
+  page.reserve(names.size());
+  for (std::string &name : names)
+  {
+    auto it = m_index.find(name);
+    page.emplace_back(std::move(name), it->second);
+  }
+  version = version_locked();
+  changed = m_changed;
+  m_lock.unlock();
+  return total;
+}
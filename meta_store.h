@@ -0,0 +1,98 @@
+#ifndef META_STORE_H
+#define META_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <utility>
+#include <unordered_map>
+#include "locker.h"
+#include "file_index.h"
+
+// 上传文件的属性
+struct file_meta
+{
+  std::string description;  // 描述信息，可以为空
+  uint64_t size;            // 文件大小
+  std::string hash;         // 内容的SHA-256，去重之前上传的文件为空
+  int64_t upload_time;      // 最后一次上传的时间(秒)
+  std::string content_type; // 上传时客户端声明的Content-Type，可以为空
+};
+
+/*
+    上传文件的元数据存储，代替每个文件一个的.desc_描述文件
+    - 所有文件的属性都在内存中的哈希表里，文件列表和查找属性不需要任何系统调用
+    - 修改以记录的形式追加到 <上传目录>/.meta/log，每条记录带CRC，崩溃时写了一半的记录在下次启动时丢弃
+    - 日志超过快照的大小(至少COMPACT_MIN_BYTES)时压缩：当前所有属性写成新的快照，原子替换旧快照并同步目录后清空日志
+    - 压缩只在复制快照内容和处理日志时持有锁，写快照文件期间的修改照常追加到日志，处理日志时保留下来
+    - 启动时映射快照文件直接解析，再重放日志，不需要逐个文件读取
+    - 第一次启动时(还没有快照，日志为空)遍历上传目录导入已有的文件和.desc_描述文件，写成快照后删除描述文件
+    - 同时维护按文件名排序和子串搜索的索引(file_index.h)，分页搜索只访问内存
+    - 每次修改都会改变版本号，版本号由打开时间和修改次数组成，重启后不会与之前的版本相同，可以直接用作ETag
+    - 所有方法都可以在多个线程中同时调用
+*/
+class meta_store
+{
+public:
+  static const uint64_t COMPACT_MIN_BYTES = 1024 * 1024; // 日志至少达到这个大小才压缩
+
+  static meta_store &instance();
+
+  // 打开上传目录中的元数据，失败时返回false，调用者不应继续使用
+  bool open(const std::string &dir);
+
+  // 新建或覆盖文件的属性，description为空时保留原来的描述
+  void put(const std::string &name, file_meta meta);
+  void remove(const std::string &name);
+
+  bool get(const std::string &name, file_meta &meta);
+  size_t size();
+  // 按文件名顺序返回排在after之后的最多limit个文件及其属性，after为空时从头开始
+  void list_after(const std::string &after, size_t limit, std::vector<std::pair<std::string, file_meta>> &page);
+
+  // 当前版本号，changed返回最后一次修改的时间
+  std::string version(int64_t &changed);
+  // 按文件名顺序分页返回文件名包含query的文件及其属性，返回匹配的总数
+  // version和changed是结果对应的版本，与搜索在同一次加锁中取得
+  size_t search(const std::string &query, size_t offset, size_t limit,
+                std::vector<std::pair<std::string, file_meta>> &page, std::string &version, int64_t &changed);
+
+private:
+  meta_store() : m_log_fd(-1), m_log_bytes(0), m_snapshot_bytes(0), m_compacting(false), m_epoch(0), m_generation(0), m_changed(0) {}
+
+  enum RECORD_TYPE
+  {
+    RECORD_PUT = 1,
+    RECORD_DELETE = 2
+  };
+
+  static void encode_put(const std::string &name, const file_meta &meta, std::string &out);
+  static void encode_delete(const std::string &name, std::string &out);
+  // 依次应用data中完整且校验正确的记录，返回这些记录的总长度
+  size_t replay(const char *data, size_t len);
+  bool load_file(const std::string &path, uint64_t &valid_bytes, uint64_t &file_bytes);
+  bool import_legacy(const std::string &dir);
+  bool append(const std::string &record);
+  bool compact();
+  bool write_snapshot(const std::string &data);
+  bool drop_compacted_log();
+  void touch();
+  std::string version_locked() const;
+
+  std::string m_meta_dir;
+  int m_log_fd; // 追加写的日志，打开失败时为-1
+  uint64_t m_log_bytes;
+  uint64_t m_snapshot_bytes;
+  bool m_compacting;          // 正在写快照，同时只有一个线程压缩
+  std::string m_compact_tail; // 写快照期间追加的记录，快照中没有，替换日志时保留
+  std::unordered_map<std::string, file_meta> m_index;
+  file_index m_files;
+  int64_t m_epoch;       // 打开的时间
+  uint64_t m_generation; // 打开以来的修改次数
+  int64_t m_changed;     // 最后一次修改的时间
+  locker m_lock;
+};
+
+#endif
@@ -0,0 +1,187 @@
+#include "multipart_upload.h"
+#include <stdio.h>
+#include <strings.h>
+#include <time.h>
+#include "upload_sink.h"
+#include "meta_store.h"
+
+threadpool<upload_write_task> *upload_batch::m_pool = NULL;
+
+static std::string_view trim(std::string_view s)
+{
+  while (!s.empty() && (s.front() == ' ' || s.front() == '\t'))
+  {
+    s.remove_prefix(1);
+  }
+  while (!s.empty() && (s.back() == ' ' || s.back() == '\t'))
+  {
+    s.remove_suffix(1);
+  }
+  return s;
+}
+
+// 从部分的头部中取出Content-Disposition的name和filename参数，以及Content-Type
+static void parse_disposition(std::string_view headers, form_part &part)
+{
+  static const std::string_view DISPOSITION = "Content-Disposition:";
+  static const std::string_view CONTENT_TYPE = "Content-Type:";
+  while (!headers.empty())
+  {
+    size_t eol = headers.find("\r\n");
+    std::string_view line = headers.substr(0, eol);
+    headers.remove_prefix(eol == std::string_view::npos ? headers.size() : eol + 2);
+    if (line.size() >= CONTENT_TYPE.size() && strncasecmp(line.data(), CONTENT_TYPE.data(), CONTENT_TYPE.size()) == 0)
+    {
+      part.content_type = trim(line.substr(CONTENT_TYPE.size()));
+      continue;
+    }
+    if (line.size() < DISPOSITION.size() || strncasecmp(line.data(), DISPOSITION.data(), DISPOSITION.size()) != 0)
+    {
+      continue;
+    }
+
+    // 参数以;分隔，如 form-data; name="files"; filename="a.txt"
+    std::string_view params = line.substr(DISPOSITION.size());
+    while (!params.empty())
+    {
+      size_t semi = params.find(';');
+      std::string_view param = trim(params.substr(0, semi));
+      params.remove_prefix(semi == std::string_view::npos ? params.size() : semi + 1);
+
+      size_t eq = param.find('=');
+      if (eq == std::string_view::npos)
+      {
+        continue;
+      }
+      std::string_view key = trim(param.substr(0, eq));
+      std::string_view value = trim(param.substr(eq + 1));
+      if (value.size() >= 2 && value.front() == '"' && value.back() == '"')
+      {
+        value = value.substr(1, value.size() - 2);
+      }
+      if (key == "name")
+      {
+        part.name = value;
+      }
+      else if (key == "filename")
+      {
+        part.filename = value;
+        part.is_file = true;
+      }
+    }
+  }
+}
+
+bool parse_multipart(std::string_view body, const std::string &boundary, std::vector<form_part> &parts)
+{
+  if (boundary.empty())
+  {
+    return false;
+  }
+  std::string delimiter = "--" + boundary;
+  std::string close = "\r\n" + delimiter; // 每个部分的内容以\r\n和下一个分界线结束
+
+  size_t pos = body.find(delimiter);
+  if (pos == std::string_view::npos)
+  {
+    return false;
+  }
+  pos += delimiter.size();
+
+  while (true)
+  {
+    // 分界线后紧跟--表示表单结束，否则换行后是下一个部分的头部
+    if (body.compare(pos, 2, "--") == 0)
+    {
+      return true;
+    }
+    if (body.compare(pos, 2, "\r\n") != 0)
+    {
+      return false;
+    }
+
+    // 头部以空行结束，没有头部时空行紧跟在分界线之后
+    size_t headers_end = body.find("\r\n\r\n", pos);
+    if (headers_end == std::string_view::npos)
+    {
+      return false;
+    }
+    form_part part;
+    part.is_file = false;
+    if (headers_end > pos)
+    {
+      parse_disposition(body.substr(pos + 2, headers_end - pos - 2), part);
+    }
+
+    size_t content_start = headers_end + 4;
+    size_t next = body.find(close, content_start);
+    if (next == std::string_view::npos)
+    {
+      return false;
+    }
+    part.content = body.substr(content_start, next - content_start);
+    parts.push_back(std::move(part));
+    pos = next + close.size();
+  }
+}
+
+void upload_write_task::process()
+{
+  // 与PUT相同，经过上传缓冲区写入临时文件，全部写完后重命名，读取者不会看到写了一半的文件
+  upload_sink sink(path, data.size());
+  ok = true;
+  size_t done = 0;
+  while (done < data.size())
+  {
+    done += sink.append(data.data() + done, data.size() - done);
+    if (!sink.flush())
+    {
+      ok = false;
+      break;
+    }
+  }
+  bool existed;
+  ok = ok && sink.commit(existed);
+
+  if (ok)
+  {
+    meta_store::instance().put(name, {description, sink.size(), sink.hash(), (int64_t)time(NULL), content_type});
+    printf("文件上传成功: %s\n", path.c_str());
+  }
+  batch->task_done();
+}
+
+void upload_batch::add(const std::string &name, const std::string &path, std::string_view data,
+                       std::string_view description, const std::string &content_type)
+{
+  m_tasks.push_back({name, path, data, std::string(description), content_type, false, this});
+}
+
+bool upload_batch::run()
+{
+  // 任务提交之后数组不能再变化，线程池持有的是元素的地址
+  for (size_t i = 1; i < m_tasks.size(); i++)
+  {
+    if (!m_pool || !m_pool->append(&m_tasks[i]))
+    {
+      m_tasks[i].process();
+    }
+  }
+  if (!m_tasks.empty())
+  {
+    m_tasks[0].process();
+  }
+
+  bool ok = true;
+  for (size_t i = 0; i < m_tasks.size(); i++)
+  {
+    while (!m_done.wait())
+    {
+    }
+  }
+  for (const upload_write_task &task : m_tasks)
+  {
+    ok = ok && task.ok;
+  }
+  return ok;
+}
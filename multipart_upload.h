@@ -0,0 +1,64 @@
+#ifndef MULTIPART_UPLOAD_H
+#define MULTIPART_UPLOAD_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include "locker.h"
+#include "threadpool.h"
+
+// multipart/form-data请求体中的一个部分
+struct form_part
+{
+  std::string name;         // 字段名
+  std::string filename;     // 文件字段的文件名，没有选择文件时为空
+  bool is_file;             // Content-Disposition中带有filename参数
+  std::string content_type; // 部分头部中的Content-Type，可以为空
+  std::string_view content; // 指向请求体内部，不拷贝
+};
+
+// 按出现顺序解析所有部分，boundary不含前导的--，格式错误时返回false
+bool parse_multipart(std::string_view body, const std::string &boundary, std::vector<form_part> &parts);
+
+class upload_batch;
+
+// 一个上传文件的写盘任务，由上传写入线程池执行
+struct upload_write_task
+{
+  std::string name;         // 文件名，作为元数据的键
+  std::string path;         // 目标文件
+  std::string_view data;    // 文件内容，指向请求体，等待期间请求体保持有效
+  std::string description;  // 为空时保留文件原来的描述
+  std::string content_type;
+  bool ok;
+  upload_batch *batch;
+
+  void process();
+};
+
+/*
+    一次请求中多个文件的并行写入
+    - 每个文件是一个独立的任务：先写入同目录的临时文件，写完后原子地重命名为目标文件，再记录元数据
+    - 除第一个文件外的任务提交给上传写入线程池，第一个文件在当前线程写入，多个文件的写盘互相重叠
+    - 线程池为空或队列已满时在当前线程依次写入
+    - run在全部任务完成后才返回，任务引用的请求体在此之前保持有效
+*/
+class upload_batch
+{
+public:
+  static threadpool<upload_write_task> *m_pool; // 上传写入线程池，为NULL时在当前线程写入
+
+  void add(const std::string &name, const std::string &path, std::string_view data,
+           std::string_view description, const std::string &content_type);
+
+  // 执行所有任务并等待完成，返回是否全部写入成功
+  bool run();
+
+  void task_done() { m_done.post(); }
+
+private:
+  std::vector<upload_write_task> m_tasks;
+  sem m_done; // 每完成一个任务post一次
+};
+
+#endif
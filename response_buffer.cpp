@@ -0,0 +1,376 @@
+#include "response_buffer.h"
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <charconv>
+#include <algorithm>
+
+file_buffer_pool &file_buffer_pool::instance()
+{
+  static file_buffer_pool pool;
+  return pool;
+}
+
+file_buffer_pool::~file_buffer_pool()
+{
+  for (char *buf : m_free)
+  {
+    delete[] buf;
+  }
+}
+
+std::shared_ptr<char> file_buffer_pool::acquire()
+{
+  char *buf = nullptr;
+  m_lock.lock();
+  if (!m_free.empty())
+  {
+    buf = m_free.back();
+    m_free.pop_back();
+  }
+  m_lock.unlock();
+
+  if (!buf)
+  {
+    buf = new char[m_buffer_size];
+  }
+  return std::shared_ptr<char>(buf, [this](char *p)
+                               { release(p); });
+}
+
+void file_buffer_pool::release(char *buf)
+{
+  m_lock.lock();
+  if (m_free.size() < MAX_CACHED_BYTES / std::max<size_t>(m_buffer_size, 1))
+  {
+    m_free.push_back(buf);
+    buf = nullptr;
+  }
+  m_lock.unlock();
+
+  // 池已满，直接归还给系统
+  delete[] buf;
+}
+
+file_window::file_window(int fd, uint64_t size) : m_fd(fd), m_size(size)
+{
+  // 顺序读取，内核加大预读窗口
+  posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+}
+
+file_window::~file_window()
+{
+  unmap_window();
+  close(m_fd);
+}
+
+const char *file_window::data_at(uint64_t offset, size_t &avail, bool can_remap)
+{
+  if (!m_window || offset < m_window_offset || offset >= m_window_offset + m_window_len)
+  {
+    if (!can_remap || !map_window(offset))
+    {
+      avail = 0;
+      return nullptr;
+    }
+  }
+  avail = m_window_offset + m_window_len - offset;
+  return m_window + (offset - m_window_offset);
+}
+
+bool file_window::map_window(uint64_t offset)
+{
+  uint64_t old_offset = m_window_offset;
+  size_t old_len = m_window_len;
+  unmap_window();
+
+  // 窗口起点按窗口大小对齐，与页缓存中的大页folio边界一致
+  uint64_t start = offset / WINDOW_SIZE * WINDOW_SIZE;
+  size_t len = std::min<uint64_t>((uint64_t)WINDOW_SIZE, m_size - start);
+  void *addr = mmap(0, len, PROT_READ, MAP_PRIVATE, m_fd, start);
+  if (addr == MAP_FAILED)
+  {
+    return false;
+  }
+  madvise(addr, len, MADV_SEQUENTIAL);
+  m_window = static_cast<char *>(addr);
+  m_window_offset = start;
+  m_window_len = len;
+
+  // 提前预读下一个窗口，使磁盘读取始终领先于发送
+  if (start + len < m_size)
+  {
+    posix_fadvise(m_fd, start + len, WINDOW_SIZE, POSIX_FADV_WILLNEED);
+  }
+
+  // 一次性的超大文件，已发送完的窗口不会再用到，丢弃它的页缓存
+  if (m_size >= DROP_BEHIND_MIN_SIZE && old_len > 0 && old_offset + old_len <= start)
+  {
+    posix_fadvise(m_fd, old_offset, old_len, POSIX_FADV_DONTNEED);
+  }
+  return true;
+}
+
+void file_window::unmap_window()
+{
+  if (m_window)
+  {
+    munmap(m_window, m_window_len);
+    m_window = nullptr;
+    m_window_len = 0;
+  }
+}
+
+chunk_pool &chunk_pool::instance()
+{
+  static chunk_pool pool;
+  return pool;
+}
+
+chunk_pool::~chunk_pool()
+{
+  for (buffer_chunk *chunk : m_free)
+  {
+    delete chunk;
+  }
+}
+
+buffer_chunk *chunk_pool::acquire()
+{
+  buffer_chunk *chunk = nullptr;
+  m_lock.lock();
+  if (!m_free.empty())
+  {
+    chunk = m_free.back();
+    m_free.pop_back();
+  }
+  m_lock.unlock();
+
+  if (!chunk)
+  {
+    chunk = new buffer_chunk;
+  }
+  chunk->refs = 0;
+  return chunk;
+}
+
+void chunk_pool::release(buffer_chunk *chunk)
+{
+  m_lock.lock();
+  if (m_free.size() < MAX_CACHED_CHUNKS)
+  {
+    m_free.push_back(chunk);
+    chunk = nullptr;
+  }
+  m_lock.unlock();
+
+  // 池已满，直接归还给系统
+  delete chunk;
+}
+
+void response_buffer::append(std::string_view data)
+{
+  while (!data.empty())
+  {
+    if (!m_tail || m_tail_used == buffer_chunk::CHUNK_SIZE)
+    {
+      // 旧的尾块如果已经没有片段引用，说明数据已发送完，直接归还
+      if (m_tail && m_tail->refs == 0)
+      {
+        chunk_pool::instance().release(m_tail);
+      }
+      m_tail = chunk_pool::instance().acquire();
+      m_tail_used = 0;
+    }
+
+    size_t n = std::min(data.size(), buffer_chunk::CHUNK_SIZE - m_tail_used);
+    char *dst = m_tail->data + m_tail_used;
+    memcpy(dst, data.data(), n);
+
+    // 与上一个片段在同一块内且连续时直接合并，减少iovec的数量
+    if (!m_segments.empty() && m_segments.back().chunk == m_tail &&
+        m_segments.back().data + m_segments.back().len == dst)
+    {
+      m_segments.back().len += n;
+    }
+    else
+    {
+      m_segments.push_back({dst, n, m_tail, nullptr, nullptr, 0});
+      m_tail->refs++;
+    }
+
+    m_tail_used += n;
+    m_appended += n;
+    data.remove_prefix(n);
+  }
+}
+
+void response_buffer::append_number(int64_t value)
+{
+  char num[24];
+  char *end = std::to_chars(num, num + sizeof(num), value).ptr;
+  append(std::string_view(num, end - num));
+}
+
+void response_buffer::append_external(const char *data, size_t len, std::shared_ptr<const void> owner)
+{
+  if (len == 0)
+  {
+    return;
+  }
+  m_segments.push_back({data, len, nullptr, std::move(owner), nullptr, 0});
+  m_appended += len;
+}
+
+void response_buffer::append_file(std::shared_ptr<file_window> file, uint64_t offset, uint64_t len)
+{
+  if (len == 0)
+  {
+    return;
+  }
+  m_segments.push_back({nullptr, len, nullptr, nullptr, std::move(file), offset});
+  m_appended += len;
+}
+
+void response_buffer::end_response(bool keep_alive)
+{
+  m_marks.push_back({m_appended, keep_alive});
+}
+
+int response_buffer::fill_iovec(struct iovec *iov, int max_iov)
+{
+  int count = 0;
+  for (auto it = m_segments.begin(); it != m_segments.end() && count < max_iov; ++it)
+  {
+    if (!it->file)
+    {
+      iov[count].iov_base = const_cast<char *>(it->data);
+      iov[count].iov_len = it->len;
+      count++;
+      continue;
+    }
+
+    // 重新映射窗口会使之前填入的同一文件的地址失效，因此只允许第一个iovec或尚未映射的文件触发映射
+    size_t avail;
+    const char *data = it->file->data_at(it->file_offset, avail, count == 0 || !it->file->mapped());
+    if (!data)
+    {
+      break;
+    }
+    iov[count].iov_base = const_cast<char *>(data);
+    iov[count].iov_len = std::min(avail, it->len);
+    count++;
+    if (avail < it->len)
+    {
+      // 窗口之后的数据要等下一次调用再映射
+      break;
+    }
+  }
+  return count;
+}
+
+void response_buffer::consume(size_t n)
+{
+  m_consumed += n;
+  while (n > 0 && !m_segments.empty())
+  {
+    segment &front = m_segments.front();
+    if (n < front.len)
+    {
+      // 片段只发送了一部分
+      if (front.file)
+      {
+        front.file_offset += n;
+      }
+      else
+      {
+        front.data += n;
+      }
+      front.len -= n;
+      break;
+    }
+
+    n -= front.len;
+    release_ref(front.chunk);
+    m_segments.pop_front();
+  }
+
+  // 记录已经完整发送的响应
+  while (!m_marks.empty() && m_marks.front().end <= m_consumed)
+  {
+    if (!m_marks.front().keep_alive)
+    {
+      m_close_requested = true;
+    }
+    m_marks.pop_front();
+  }
+}
+
+void response_buffer::transfer(response_buffer &dst, size_t n)
+{
+  size_t left = n;
+  for (auto it = m_segments.begin(); it != m_segments.end() && left > 0; ++it)
+  {
+    size_t len = std::min(left, it->len);
+    if (it->file)
+    {
+      dst.append_file(it->file, it->file_offset, len);
+    }
+    else if (it->chunk)
+    {
+      dst.append(std::string_view(it->data, len));
+    }
+    else
+    {
+      dst.append_external(it->data, len, it->owner);
+    }
+    left -= len;
+  }
+  consume(n - left);
+}
+
+void response_buffer::swap(response_buffer &other)
+{
+  std::swap(m_segments, other.m_segments);
+  std::swap(m_marks, other.m_marks);
+  std::swap(m_tail, other.m_tail);
+  std::swap(m_tail_used, other.m_tail_used);
+  std::swap(m_appended, other.m_appended);
+  std::swap(m_consumed, other.m_consumed);
+  std::swap(m_close_requested, other.m_close_requested);
+}
+
+void response_buffer::release_ref(buffer_chunk *chunk)
+{
+  if (!chunk || --chunk->refs > 0)
+  {
+    return;
+  }
+  if (chunk == m_tail)
+  {
+    // 尾块上的数据都已发送，从头复用
+    m_tail_used = 0;
+    return;
+  }
+  chunk_pool::instance().release(chunk);
+}
+
+void response_buffer::clear()
+{
+  while (!m_segments.empty())
+  {
+    release_ref(m_segments.front().chunk);
+    m_segments.pop_front();
+  }
+  if (m_tail)
+  {
+    chunk_pool::instance().release(m_tail);
+    m_tail = nullptr;
+    m_tail_used = 0;
+  }
+  m_marks.clear();
+  m_appended = 0;
+  m_consumed = 0;
+  m_close_requested = false;
+}
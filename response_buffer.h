@@ -0,0 +1,181 @@
+#ifndef RESPONSE_BUFFER_H
+#define RESPONSE_BUFFER_H
+
+#include <sys/uio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string_view>
+#include <memory>
+#include <deque>
+#include <vector>
+#include "locker.h"
+
+// 响应缓冲区使用的固定大小内存块
+struct buffer_chunk
+{
+  static const size_t CHUNK_SIZE = 4096;
+
+  char data[CHUNK_SIZE];
+  int refs; // 引用该内存块的片段数，只被所属连接访问，不需要原子操作
+};
+
+// 全局内存块池，避免每个响应都向系统申请内存
+class chunk_pool
+{
+public:
+  static const size_t MAX_CACHED_CHUNKS = 1024; // 最多缓存的空闲块数量
+
+  static chunk_pool &instance();
+
+  buffer_chunk *acquire();
+  void release(buffer_chunk *chunk);
+
+  ~chunk_pool();
+
+private:
+  chunk_pool() {}
+
+  std::vector<buffer_chunk *> m_free;
+  locker m_lock;
+};
+
+// 小文件读取缓冲区池
+// 小文件通过pread读入池化的缓冲区后发送，省去每个请求的mmap/munmap
+class file_buffer_pool
+{
+public:
+  static const size_t MAX_CACHED_BYTES = 16 * 1024 * 1024; // 最多缓存的空闲缓冲区总大小
+
+  static file_buffer_pool &instance();
+
+  // 缓冲区大小即小文件阈值，启动时在获取任何缓冲区之前设置
+  void set_buffer_size(size_t size) { m_buffer_size = size; }
+  size_t buffer_size() const { return m_buffer_size; }
+
+  // 最后一个引用释放时缓冲区自动归还到池中
+  std::shared_ptr<char> acquire();
+
+  ~file_buffer_pool();
+
+private:
+  file_buffer_pool() {}
+  void release(char *buf);
+
+  size_t m_buffer_size = 16 * 1024;
+  std::vector<char *> m_free;
+  locker m_lock;
+};
+
+/*
+    按窗口映射的大文件
+    - 发送时只映射当前位置所在的固定大小窗口，每个连接占用的地址空间和页表与文件大小无关
+    - 偏移量都是64位的，可以发送任意大小的文件
+    - 移动到新窗口时预读下一个窗口；一次性的超大文件在窗口移走后丢弃页缓存，不挤出热点文件
+    - 只被所属连接的线程访问，不需要加锁
+*/
+class file_window
+{
+public:
+  static const size_t WINDOW_SIZE = 4 * 1024 * 1024;                 // 每次映射的窗口大小，同时是预读的单位
+  static const uint64_t DROP_BEHIND_MIN_SIZE = 64ull * 1024 * 1024; // 超过该大小的文件窗口移走后丢弃页缓存
+
+  // 接管fd，析构时关闭
+  file_window(int fd, uint64_t size);
+  ~file_window();
+
+  file_window(const file_window &) = delete;
+  file_window &operator=(const file_window &) = delete;
+
+  uint64_t size() const { return m_size; }
+  bool mapped() const { return m_window != nullptr; }
+
+  // 返回offset处数据的地址，avail返回当前窗口内从offset开始连续可用的字节数
+  // offset不在当前窗口内时，can_remap为true才重新映射，否则返回nullptr
+  const char *data_at(uint64_t offset, size_t &avail, bool can_remap);
+
+private:
+  bool map_window(uint64_t offset);
+  void unmap_window();
+
+  int m_fd;
+  uint64_t m_size;
+  char *m_window = nullptr;
+  uint64_t m_window_offset = 0;
+  size_t m_window_len = 0;
+};
+
+/*
+    响应构建器
+    - 头部等小块数据通过append拷贝进池化的内存块，块写满后自动追加新块
+    - 小文件映射、动态生成的页面等大块数据通过append_external以零拷贝方式引用
+    - 大文件通过append_file按窗口引用，发送到哪里映射到哪里
+    - fill_iovec直接生成iovec数组交给writev/sendmsg，consume推进发送进度
+    - 一个连接上可以排队多个响应，end_response记录每个响应的结束位置
+*/
+class response_buffer
+{
+public:
+  response_buffer() {}
+  ~response_buffer() { clear(); }
+
+  response_buffer(const response_buffer &) = delete;
+  response_buffer &operator=(const response_buffer &) = delete;
+
+  void append(std::string_view data);
+  void append_number(int64_t value);
+  void append_external(const char *data, size_t len, std::shared_ptr<const void> owner);
+  void append_file(std::shared_ptr<file_window> file, uint64_t offset, uint64_t len);
+
+  // 标记当前响应结束，keep_alive为false表示发送完该响应后需要关闭连接
+  void end_response(bool keep_alive);
+
+  // 从当前发送位置开始填充iovec，返回填充的个数；大文件片段只填充当前窗口内的部分
+  int fill_iovec(struct iovec *iov, int max_iov);
+
+  // 已发送n个字节，释放发送完的片段
+  void consume(size_t n);
+
+  // 把开头的n个字节移动到dst末尾：内存块中的数据拷贝过去，外部数据连同所有者一起转交，不拷贝
+  void transfer(response_buffer &dst, size_t n);
+
+  void swap(response_buffer &other);
+
+  bool empty() const { return m_segments.empty(); }
+  uint64_t pending_bytes() const { return m_appended - m_consumed; }
+
+  // 已完整发送的响应中是否有要求关闭连接的
+  bool close_requested() const { return m_close_requested; }
+
+  void clear();
+
+private:
+  struct segment
+  {
+    const char *data;
+    size_t len;
+    buffer_chunk *chunk;                // 数据位于池化内存块中时指向该块，否则为nullptr
+    std::shared_ptr<const void> owner; // 外部数据的所有者，保证发送完之前数据有效
+    std::shared_ptr<file_window> file; // 大文件片段的数据源，此时data不使用
+    uint64_t file_offset;              // 大文件片段下一个待发送字节在文件中的偏移
+  };
+
+  struct response_mark
+  {
+    uint64_t end; // 响应最后一个字节之后的位置
+    bool keep_alive;
+  };
+
+  void release_ref(buffer_chunk *chunk);
+
+  std::deque<segment> m_segments;
+  std::deque<response_mark> m_marks;
+
+  buffer_chunk *m_tail = nullptr; // 当前用于追加数据的内存块
+  size_t m_tail_used = 0;
+
+  uint64_t m_appended = 0; // 累计追加的字节数
+  uint64_t m_consumed = 0; // 累计发送的字节数
+  bool m_close_requested = false;
+};
+
+#endif
@@ -0,0 +1,133 @@
+/*
+    上传目录布局的基准测试，比较扁平目录和分层布局(upload_layout.h)在大量文件时的表现
+    - create: 依次创建N个空文件
+    - stat:   随机选取文件名，按布局计算路径后stat，对应下载和删除时的查找
+    - list:   遍历全部文件并逐个stat，对应文件列表页面
+    - unlink: 删除全部文件
+    两种布局使用同一组文件名，结果以每秒操作数输出
+
+    编译：g++ -std=c++17 -O2 -o lookup_bench test_presure/lookup_bench.cpp upload_layout.cpp
+    运行：./lookup_bench [文件数，默认1000000] [测试目录]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <functional>
+#include "../upload_layout.h"
+
+static const size_t STAT_COUNT = 200000; // 随机查找的次数
+
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void report(const char *layout, const char *op, size_t count, double secs)
+{
+  printf("%-8s %-8s %10zu 次 %8.3f 秒 %12.0f 次/秒\n", layout, op, count, secs, count / secs);
+}
+
+// 在dir中按path_of给出的路径执行各项测试
+static void run(const char *layout, const std::string &dir, const std::vector<std::string> &names,
+                const std::function<std::string(const std::string &)> &path_of, bool sharded)
+{
+  mkdir(dir.c_str(), 0755);
+
+  auto start = std::chrono::steady_clock::now();
+  for (const std::string &name : names)
+  {
+    std::string path = path_of(name);
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 && sharded && upload_layout::make_parent_dirs(path))
+    {
+      fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    if (fd < 0)
+    {
+      perror(path.c_str());
+      exit(1);
+    }
+    close(fd);
+  }
+  report(layout, "create", names.size(), seconds_since(start));
+
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<size_t> pick(0, names.size() - 1);
+  start = std::chrono::steady_clock::now();
+  size_t found = 0;
+  for (size_t i = 0; i < STAT_COUNT; i++)
+  {
+    struct stat st;
+    found += stat(path_of(names[pick(rng)]).c_str(), &st) == 0;
+  }
+  report(layout, "stat", STAT_COUNT, seconds_since(start));
+  if (found != STAT_COUNT)
+  {
+    printf("查找失败 %zu 次\n", STAT_COUNT - found);
+  }
+
+  start = std::chrono::steady_clock::now();
+  size_t listed = 0;
+  if (sharded)
+  {
+    upload_walker walker(dir);
+    std::string name, path;
+    struct stat st;
+    while (walker.next(name, path))
+    {
+      listed += stat(path.c_str(), &st) == 0;
+    }
+  }
+  else
+  {
+    DIR *d = opendir(dir.c_str());
+    struct dirent *entry;
+    struct stat st;
+    while ((entry = readdir(d)) != NULL)
+    {
+      if (entry->d_name[0] != '.')
+      {
+        listed += stat((dir + "/" + entry->d_name).c_str(), &st) == 0;
+      }
+    }
+    closedir(d);
+  }
+  report(layout, "list", listed, seconds_since(start));
+
+  start = std::chrono::steady_clock::now();
+  for (const std::string &name : names)
+  {
+    unlink(path_of(name).c_str());
+  }
+  report(layout, "unlink", names.size(), seconds_since(start));
+}
+
+int main(int argc, char *argv[])
+{
+  size_t count = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+  std::string base = argc > 2 ? argv[2] : "/tmp/lookup_bench";
+  mkdir(base.c_str(), 0755);
+
+  // 文件名模仿用户上传的文件
+  std::vector<std::string> names;
+  names.reserve(count);
+  for (size_t i = 0; i < count; i++)
+  {
+    names.push_back("report_" + std::to_string(i) + ".pdf");
+  }
+
+  std::string flat = base + "/flat";
+  run("flat", flat, names, [&](const std::string &name) { return flat + "/" + name; }, false);
+
+  std::string sharded = base + "/sharded";
+  run("sharded", sharded, names, [&](const std::string &name) { return upload_layout::path(sharded, name); }, true);
+  return 0;
+}
@@ -0,0 +1,181 @@
+/*
+    小文件读取方式的基准测试，用于确定服务器 -p 参数(pread阈值)的取值
+    - pread:  打开文件，pread到复用的缓冲区，通过socket发送，关闭文件
+    - mmap:   打开文件，mmap(MAP_POPULATE)，通过socket发送映射的内存，munmap，关闭文件
+    每种大小的文件用多个线程同时测试，munmap在多线程进程中引起的TLB shootdown会计入mmap的耗时
+    输出每种大小下两种方式的吞吐量，以及mmap开始快于pread的大小
+
+    编译：g++ -std=c++17 -O2 -o read_bench read_bench.cpp -pthread
+    运行：./read_bench [线程数] [测试目录]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <thread>
+#include <vector>
+#include <string>
+#include <atomic>
+#include <chrono>
+
+static const double RUN_SECONDS = 1.0; // 每种大小、每种方式的测试时长
+static const size_t SIZES[] = {1024, 4096, 8192, 16384, 32768, 65536, 131072, 262144, 524288, 1048576};
+
+// 把整个缓冲区写入socket，由对端线程读走丢弃，模拟发送给客户端
+static void send_all(int fd, const char *data, size_t len)
+{
+  while (len > 0)
+  {
+    ssize_t n = write(fd, data, len);
+    if (n <= 0)
+    {
+      return;
+    }
+    data += n;
+    len -= n;
+  }
+}
+
+static bool read_once(const char *path, size_t size, std::vector<char> &buf, int sock)
+{
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+  {
+    return false;
+  }
+  size_t done = 0;
+  while (done < size)
+  {
+    ssize_t n = pread(fd, buf.data() + done, size - done, done);
+    if (n <= 0)
+    {
+      break;
+    }
+    done += n;
+  }
+  close(fd);
+  send_all(sock, buf.data(), done);
+  return done == size;
+}
+
+static bool map_once(const char *path, size_t size, int sock)
+{
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+  {
+    return false;
+  }
+  void *addr = mmap(0, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED)
+  {
+    return false;
+  }
+  send_all(sock, (const char *)addr, size);
+  munmap(addr, size);
+  return true;
+}
+
+// 用threads个线程同时测试一种方式，返回每秒完成的次数
+static double run(const char *path, size_t size, int threads, bool use_mmap)
+{
+  std::atomic<bool> stop(false);
+  std::atomic<uint64_t> total(0);
+  std::vector<std::thread> workers;
+  for (int i = 0; i < threads; i++)
+  {
+    workers.emplace_back([&]()
+                         {
+      int sv[2];
+      if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+      {
+        return;
+      }
+      // 对端线程只负责读走数据
+      std::thread drain([fd = sv[1]]()
+                        {
+        char sink[65536];
+        while (read(fd, sink, sizeof(sink)) > 0)
+        {
+        } });
+
+      std::vector<char> buf(size);
+      uint64_t count = 0;
+      while (!stop.load(std::memory_order_relaxed))
+      {
+        bool ok = use_mmap ? map_once(path, size, sv[0]) : read_once(path, size, buf, sv[0]);
+        if (!ok)
+        {
+          break;
+        }
+        count++;
+      }
+      total += count;
+      shutdown(sv[0], SHUT_WR);
+      drain.join();
+      close(sv[0]);
+      close(sv[1]); });
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  std::this_thread::sleep_for(std::chrono::duration<double>(RUN_SECONDS));
+  stop = true;
+  for (auto &t : workers)
+  {
+    t.join();
+  }
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return total / elapsed;
+}
+
+int main(int argc, char *argv[])
+{
+  int threads = argc > 1 ? atoi(argv[1]) : (int)std::thread::hardware_concurrency();
+  const char *dir = argc > 2 ? argv[2] : "/tmp";
+  if (threads <= 0)
+  {
+    threads = 1;
+  }
+
+  printf("线程数: %d\n", threads);
+  printf("%10s %14s %14s %8s\n", "大小", "pread(次/秒)", "mmap(次/秒)", "比值");
+
+  size_t crossover = 0;
+  for (size_t size : SIZES)
+  {
+    // 生成测试文件，并先读一遍使其位于页缓存中
+    std::string path = std::string(dir) + "/read_bench_" + std::to_string(size);
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+      printf("无法创建测试文件 %s\n", path.c_str());
+      return -1;
+    }
+    std::vector<char> data(size, 'x');
+    send_all(fd, data.data(), size);
+    pread(fd, data.data(), size, 0);
+    close(fd);
+
+    double r = run(path.c_str(), size, threads, false);
+    double m = run(path.c_str(), size, threads, true);
+    printf("%10zu %14.0f %14.0f %8.2f\n", size, r, m, m / r);
+    if (crossover == 0 && m > r)
+    {
+      crossover = size;
+    }
+    unlink(path.c_str());
+  }
+
+  if (crossover == 0)
+  {
+    printf("测试范围内pread始终更快，可以把 -p 设为 %zu 或更大\n", SIZES[sizeof(SIZES) / sizeof(SIZES[0]) - 1]);
+  }
+  else
+  {
+    printf("从 %zu 字节开始mmap更快，建议 -p 设为小于该值的测试点\n", crossover);
+  }
+  return 0;
+}
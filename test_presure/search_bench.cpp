@@ -0,0 +1,92 @@
+/*
+    文件名索引(file_index.h)的基准测试，对应GET /api/files的各种请求
+    - build:  由全部文件名建立索引，对应服务器启动
+    - page:   不带搜索条件随机取一页
+    - rare:   搜索只匹配一个文件的子串
+    - medium: 搜索匹配约1%文件的子串
+    - common: 搜索匹配大部分文件的子串(走顺序匹配)
+    - again:  重复上一次搜索翻到下一页，命中结果缓存
+    - insert/erase: 逐个加入和删除文件名，对应上传和删除
+    搜索都取第一页(50个)，结果以每次操作的微秒数输出
+
+    编译：g++ -std=c++17 -O2 -o search_bench test_presure/search_bench.cpp file_index.cpp
+    运行：./search_bench [文件数，默认1000000]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <functional>
+#include "../file_index.h"
+
+static const size_t PAGE = 50;
+
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// 执行times次op，输出平均耗时
+static void measure(const char *name, size_t times, const std::function<size_t(size_t)> &op)
+{
+  size_t total = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < times; i++)
+  {
+    total = op(i);
+  }
+  double secs = seconds_since(start);
+  printf("%-8s %8zu 次 %10.1f 微秒/次  匹配 %zu\n", name, times, secs * 1e6 / times, total);
+}
+
+int main(int argc, char *argv[])
+{
+  size_t count = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+
+  // 文件名模仿用户上传的文件：若干单词、编号和扩展名
+  static const char *WORDS[] = {"report", "Invoice", "photo", "backup", "notes", "draft", "final", "scan",
+                                "meeting", "budget", "contract", "slides", "thesis", "holiday", "receipt", "log"};
+  static const char *EXTS[] = {".pdf", ".jpg", ".txt", ".docx", ".png", ".zip", ".mp4", ".xlsx"};
+  std::mt19937 rng(1);
+  std::vector<std::string> names;
+  names.reserve(count);
+  for (size_t i = 0; i < count; i++)
+  {
+    names.push_back(std::string(WORDS[rng() % 16]) + "_" + WORDS[rng() % 16] + "_" + std::to_string(i) +
+                    "_" + std::to_string(2000 + rng() % 100) + EXTS[rng() % 8]);
+  }
+
+  file_index index;
+  auto start = std::chrono::steady_clock::now();
+  index.build(names);
+  printf("build    %8zu 个 %10.3f 秒\n", index.size(), seconds_since(start));
+
+  std::vector<std::string> page;
+  std::uniform_int_distribution<size_t> pick(0, count - 1);
+  measure("page", 100000, [&](size_t)
+          { return index.search("", pick(rng), PAGE, page); });
+
+  // 每次使用不同的查询串，不命中缓存
+  measure("rare", 20000, [&](size_t)
+          { return index.search("_" + std::to_string(pick(rng)) + "_", 0, PAGE, page); });
+  measure("medium", 200, [&](size_t i)
+          { return index.search(std::string(WORDS[i % 16]) + "_" + WORDS[(i / 16) % 16] + "_" + std::to_string(i % 10), 0, PAGE, page); });
+  measure("common", 20, [&](size_t i)
+          { return index.search(i % 2 ? "_20" : "PDF", 0, PAGE, page); });
+  measure("again", 100000, [&](size_t i)
+          { return index.search("PDF", (i % 100) * PAGE, PAGE, page); });
+
+  measure("insert", 100000, [&](size_t i)
+          {
+            index.insert("upload_" + std::to_string(i) + ".bin");
+            return index.size();
+          });
+  measure("erase", 100000, [&](size_t i)
+          {
+            index.erase("upload_" + std::to_string(i) + ".bin");
+            return index.size();
+          });
+  return 0;
+}
@@ -2,11 +2,20 @@
 #define THREADPOOL_H
 
 #include <pthread.h>
+#include <stdint.h>
 #include <queue>
 #include <exception>
 #include <cstdio>
 #include "locker.h"
 
+// 线程池的运行统计
+struct pool_stats
+{
+  size_t depth;       // 当前排队的任务数
+  size_t peak_depth;  // 上次读取统计以来的最大排队数
+  uint64_t completed; // 累计被工作线程取出执行的任务数
+};
+
 // 线程池类，定义成模板类为了代码复用,模板参数T是任务类
 template <typename T>
 class threadpool
@@ -18,6 +27,9 @@ public:
 
   bool append(T *requset);
 
+  // 读取队列深度等统计信息，同时重新开始记录峰值
+  pool_stats stats();
+
 private:
   static void *worker(void *arg);
   void run();
@@ -43,11 +55,16 @@ private:
 
   // 是否结束线程
   bool m_stop;
+
+  // 统计信息，受m_queuelocker保护
+  size_t m_peak_depth;
+  uint64_t m_completed;
 };
 
 template <typename T>
 threadpool<T>::threadpool(int thread_number, int max_requests) : m_thread_number(thread_number), m_max_requests(max_requests),
-                                                                 m_stop(false), m_threads(NULL)
+                                                                 m_stop(false), m_threads(NULL),
+                                                                 m_peak_depth(0), m_completed(0)
 {
 
   if ((thread_number <= 0) || (max_requests <= 0))
@@ -98,11 +115,25 @@ bool threadpool<T>::append(T *request)
   }
 
   m_workqueue.push(request);
+  if (m_workqueue.size() > m_peak_depth)
+  {
+    m_peak_depth = m_workqueue.size();
+  }
   m_queuelocker.unlock();
   m_queuestat.post();
   return true;
 }
 
+template <typename T>
+pool_stats threadpool<T>::stats()
+{
+  m_queuelocker.lock();
+  pool_stats s = {m_workqueue.size(), m_peak_depth, m_completed};
+  m_peak_depth = m_workqueue.size();
+  m_queuelocker.unlock();
+  return s;
+}
+
 template <typename T>
 void *threadpool<T>::worker(void *arg)
 {
@@ -126,6 +157,7 @@ void threadpool<T>::run()
     }
     T *request = m_workqueue.front();
     m_workqueue.pop(); // 使用queue的pop方法而不是list的pop_front
+    m_completed++;
     m_queuelocker.unlock();
 
     if (!request)
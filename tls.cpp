@@ -0,0 +1,93 @@
+#include "tls.h"
+#include <stdio.h>
+
+static SSL_CTX *g_ctx = NULL;
+
+// 会话ID上下文，会话恢复时用于区分不同的服务
+static const unsigned char SESSION_ID_CONTEXT[] = "webserver";
+
+// ALPN协商，客户端支持时优先选择h2
+static int alpn_select(SSL *, const unsigned char **out, unsigned char *outlen,
+                       const unsigned char *in, unsigned int inlen, void *)
+{
+  static const unsigned char protos[] = "\x02h2\x08http/1.1";
+  unsigned char *selected;
+  if (SSL_select_next_proto(&selected, outlen, protos, sizeof(protos) - 1, in, inlen) != OPENSSL_NPN_NEGOTIATED)
+  {
+    return SSL_TLSEXT_ERR_NOACK;
+  }
+  *out = selected;
+  return SSL_TLSEXT_ERR_OK;
+}
+
+bool tls_init(const char *cert_file, const char *key_file)
+{
+  SSL_CTX *ctx = SSL_CTX_new(TLS_server_method());
+  if (!ctx)
+  {
+    tls_print_errors("SSL_CTX_new");
+    return false;
+  }
+
+  SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+
+#ifdef SSL_OP_ENABLE_KTLS
+  // 握手完成后尝试启用内核TLS，失败时OpenSSL会自动继续使用用户态加密
+  SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+#endif
+
+  // 内核TLS只支持AES-GCM和ChaCha20-Poly1305，优先选择这些算法
+  SSL_CTX_set_ciphersuites(ctx, "TLS_AES_128_GCM_SHA256:TLS_AES_256_GCM_SHA384:TLS_CHACHA20_POLY1305_SHA256");
+  SSL_CTX_set_cipher_list(ctx, "ECDHE+AESGCM:ECDHE+CHACHA20");
+
+  // 非阻塞写时允许部分写入，且重试时缓冲区地址可以变化
+  SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER | SSL_MODE_RELEASE_BUFFERS);
+
+  // 会话恢复：TLS1.2使用服务端会话缓存，TLS1.3默认使用会话票据
+  SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+  SSL_CTX_set_session_id_context(ctx, SESSION_ID_CONTEXT, sizeof(SESSION_ID_CONTEXT) - 1);
+  SSL_CTX_sess_set_cache_size(ctx, 20480);
+
+  SSL_CTX_set_alpn_select_cb(ctx, alpn_select, NULL);
+
+  if (SSL_CTX_use_certificate_chain_file(ctx, cert_file) <= 0 ||
+      SSL_CTX_use_PrivateKey_file(ctx, key_file, SSL_FILETYPE_PEM) <= 0 ||
+      !SSL_CTX_check_private_key(ctx))
+  {
+    tls_print_errors("加载证书或私钥失败");
+    SSL_CTX_free(ctx);
+    return false;
+  }
+
+  g_ctx = ctx;
+  return true;
+}
+
+SSL_CTX *tls_context()
+{
+  return g_ctx;
+}
+
+SSL *tls_new(int sockfd)
+{
+  SSL *ssl = SSL_new(g_ctx);
+  if (!ssl)
+  {
+    tls_print_errors("SSL_new");
+    return NULL;
+  }
+  SSL_set_fd(ssl, sockfd);
+  SSL_set_accept_state(ssl);
+  return ssl;
+}
+
+void tls_print_errors(const char *what)
+{
+  unsigned long err;
+  while ((err = ERR_get_error()) != 0)
+  {
+    char buf[256];
+    ERR_error_string_n(err, buf, sizeof(buf));
+    printf("%s: %s\n", what, buf);
+  }
+}
@@ -0,0 +1,24 @@
+#ifndef TLS_H
+#define TLS_H
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+
+// HTTPS相关的全局TLS上下文
+// 握手完成后由OpenSSL通过setsockopt(TCP_ULP, "tls")把密钥交给内核(kTLS)，
+// 之后发送路径可以直接对socket调用writev/sendfile，由内核负责加密；
+// 内核不支持kTLS时回退到SSL_write在用户态加密
+
+// 加载证书和私钥，创建全局SSL_CTX，失败返回false
+bool tls_init(const char *cert_file, const char *key_file);
+
+// 获取全局SSL_CTX，未初始化时返回NULL
+SSL_CTX *tls_context();
+
+// 为新连接创建SSL对象，进入服务端握手状态
+SSL *tls_new(int sockfd);
+
+// 打印OpenSSL错误队列
+void tls_print_errors(const char *what);
+
+#endif
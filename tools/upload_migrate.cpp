@@ -0,0 +1,115 @@
+/*
+    把旧版本的扁平上传目录迁移到分层布局(upload_layout.h)
+    - uploads/<name>            -> uploads/ab/c/<name>
+    - uploads/.desc_<name>      -> uploads/ab/c/.desc_<name>
+    - uploads/.blobs/<sha256>   -> uploads/.blobs/ab/c/<sha256>
+    - 上次运行中断留下的临时文件(.upload_*、.link_*)直接删除
+    只使用同一文件系统内的rename，文件内容和硬链接关系保持不变；可以重复运行，已经迁移的文件不会再移动
+    迁移期间服务器必须停止，迁移完成后再启动
+
+    编译：g++ -std=c++17 -O2 -o upload_migrate tools/upload_migrate.cpp upload_layout.cpp
+    运行：./upload_migrate [上传目录]
+*/
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+#include "../upload_layout.h"
+
+static const char *DEFAULT_DIR = "/home/zen/webserver/resources/uploads";
+
+// 把src移到dst，目标已存在时保留目标并报告冲突
+static bool move_to(const std::string &src, const std::string &dst)
+{
+  if (!upload_layout::make_parent_dirs(dst))
+  {
+    return false;
+  }
+  if (access(dst.c_str(), F_OK) == 0)
+  {
+    printf("跳过 %s：%s 已存在\n", src.c_str(), dst.c_str());
+    return false;
+  }
+  if (rename(src.c_str(), dst.c_str()) < 0)
+  {
+    printf("移动 %s 失败: %s\n", src.c_str(), strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+// 先读出目录中的所有名字，避免边读目录边向其中创建子目录
+static std::vector<std::string> list_dir(const std::string &dir)
+{
+  std::vector<std::string> names;
+  DIR *d = opendir(dir.c_str());
+  if (!d)
+  {
+    return names;
+  }
+  struct dirent *entry;
+  while ((entry = readdir(d)) != NULL)
+  {
+    if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0)
+    {
+      names.push_back(entry->d_name);
+    }
+  }
+  closedir(d);
+  return names;
+}
+
+int main(int argc, char *argv[])
+{
+  std::string dir = argc > 1 ? argv[1] : DEFAULT_DIR;
+  struct stat st;
+  if (stat(dir.c_str(), &st) < 0 || !S_ISDIR(st.st_mode))
+  {
+    printf("上传目录 %s 不存在\n", dir.c_str());
+    return 1;
+  }
+
+  size_t files = 0, descs = 0, blobs = 0, temps = 0, failed = 0;
+  for (const std::string &name : list_dir(dir))
+  {
+    std::string src = dir + "/" + name;
+    if (lstat(src.c_str(), &st) < 0 || !S_ISREG(st.st_mode))
+    {
+      // 子目录(包括已经迁移的分层目录和.blobs)不在这里处理
+      continue;
+    }
+    if (name.compare(0, 8, ".upload_") == 0 || name.compare(0, 6, ".link_") == 0)
+    {
+      unlink(src.c_str());
+      temps++;
+    }
+    else if (name.compare(0, 6, ".desc_") == 0)
+    {
+      move_to(src, upload_layout::desc_path(dir, name.substr(6))) ? descs++ : failed++;
+    }
+    else if (name[0] != '.')
+    {
+      move_to(src, upload_layout::path(dir, name)) ? files++ : failed++;
+    }
+  }
+
+  // 扁平的blob目录中直接存放以内容哈希命名的文件
+  std::string blob_dir = dir + "/.blobs";
+  for (const std::string &hash : list_dir(blob_dir))
+  {
+    std::string src = blob_dir + "/" + hash;
+    if (hash.size() < 3 || lstat(src.c_str(), &st) < 0 || !S_ISREG(st.st_mode))
+    {
+      continue;
+    }
+    move_to(src, upload_layout::blob_path(blob_dir, hash)) ? blobs++ : failed++;
+  }
+
+  printf("迁移完成: 文件 %zu 个，描述 %zu 个，blob %zu 个，删除临时文件 %zu 个，失败 %zu 个\n",
+         files, descs, blobs, temps, failed);
+  return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,136 @@
+#include "upload_layout.h"
+#include <stdio.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+// FNV-1a，分布均匀且与平台无关，迁移工具和服务器计算出的路径一致
+static uint32_t name_hash(const std::string &name)
+{
+  uint32_t h = 2166136261u;
+  for (unsigned char c : name)
+  {
+    h ^= c;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+std::string upload_layout::shard(const std::string &name)
+{
+  char buf[8];
+  uint32_t h = name_hash(name);
+  snprintf(buf, sizeof(buf), "%02x/%x", h >> 24, (h >> 20) & 0xf);
+  return buf;
+}
+
+std::string upload_layout::blob_path(const std::string &blob_dir, const std::string &hash)
+{
+  return blob_dir + "/" + hash.substr(0, 2) + "/" + hash.substr(2, 1) + "/" + hash;
+}
+
+std::string upload_layout::path(const std::string &dir, const std::string &name)
+{
+  return dir + "/" + shard(name) + "/" + name;
+}
+
+std::string upload_layout::desc_path(const std::string &dir, const std::string &name)
+{
+  return dir + "/" + shard(name) + "/.desc_" + name;
+}
+
+bool upload_layout::make_parent_dirs(const std::string &path)
+{
+  // 从上往下逐级创建，已存在的目录直接跳过
+  size_t end = path.rfind('/');
+  size_t pos = end;
+  for (int i = 0; i < LEVELS && pos != std::string::npos && pos > 0; i++)
+  {
+    pos = path.rfind('/', pos - 1);
+  }
+  while (pos != std::string::npos && pos < end)
+  {
+    pos = path.find('/', pos + 1);
+    if (mkdir(path.substr(0, pos).c_str(), 0755) < 0 && errno != EEXIST)
+    {
+      printf("创建上传子目录失败: %s\n", path.substr(0, pos).c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+bool upload_layout::is_shard_name(const char *name, int level)
+{
+  auto hex = [](char c)
+  {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f');
+  };
+  if (level == 0)
+  {
+    return hex(name[0]) && hex(name[1]) && name[2] == '\0';
+  }
+  return hex(name[0]) && name[1] == '\0';
+}
+
+upload_walker::upload_walker(const std::string &dir) : m_depth(0)
+{
+  for (DIR *&d : m_dirs)
+  {
+    d = NULL;
+  }
+  m_dirs[0] = opendir(dir.c_str());
+  m_paths[0] = dir;
+  m_ok = m_dirs[0] != NULL;
+  if (!m_ok)
+  {
+    m_depth = -1;
+  }
+}
+
+upload_walker::~upload_walker()
+{
+  for (DIR *d : m_dirs)
+  {
+    if (d)
+    {
+      closedir(d);
+    }
+  }
+}
+
+bool upload_walker::next(std::string &name, std::string &path)
+{
+  while (m_depth >= 0)
+  {
+    struct dirent *entry = readdir(m_dirs[m_depth]);
+    if (entry == NULL)
+    {
+      // 当前目录读完，回到上一层
+      closedir(m_dirs[m_depth]);
+      m_dirs[m_depth--] = NULL;
+      continue;
+    }
+    // 跳过.、..、描述文件、临时文件和blob目录
+    if (entry->d_name[0] == '.')
+    {
+      continue;
+    }
+
+    std::string full = m_paths[m_depth] + "/" + entry->d_name;
+    if (m_depth < upload_layout::LEVELS)
+    {
+      // 中间层只进入布局中的子目录
+      DIR *sub = upload_layout::is_shard_name(entry->d_name, m_depth) ? opendir(full.c_str()) : NULL;
+      if (sub)
+      {
+        m_dirs[++m_depth] = sub;
+        m_paths[m_depth] = full;
+      }
+      continue;
+    }
+    name = entry->d_name;
+    path = full;
+    return true;
+  }
+  return false;
+}
@@ -0,0 +1,62 @@
+#ifndef UPLOAD_LAYOUT_H
+#define UPLOAD_LAYOUT_H
+
+#include <dirent.h>
+#include <stdint.h>
+#include <string>
+
+/*
+    上传目录的分层布局
+    - 文件按文件名的哈希分到两级子目录：uploads/ab/c/<name>，第一级256个，第二级16个，共4096个叶子目录
+    - 百万级文件时每个目录约250个文件，创建文件不会因为目录过大而变慢，遍历时也不需要打开过多的目录
+      (test_presure/lookup_bench在10^6个文件时测得：65536个叶子目录时创建文件受冷目录拖累，256个时与扁平目录相当)
+    - URL中的/uploads/<name>保持不变，实际路径由文件名直接计算，查找一个文件不需要读目录
+    - 以.开头的目录(.blobs、.meta)和文件不属于布局
+    - blob目录使用相同的两级结构，子目录取内容哈希的前3个十六进制位
+*/
+class upload_layout
+{
+public:
+  static const int LEVELS = 2; // 子目录层数
+
+  // 文件名对应的子目录，如"3f/a"
+  static std::string shard(const std::string &name);
+  // 文件在上传目录dir中的实际路径
+  static std::string path(const std::string &dir, const std::string &name);
+  // 旧版本的描述文件路径，只在导入元数据和迁移时使用
+  static std::string desc_path(const std::string &dir, const std::string &name);
+  // 以内容哈希命名的blob在blob目录中的路径
+  static std::string blob_path(const std::string &blob_dir, const std::string &hash);
+  // 创建path所在的子目录(只创建布局中的两级，上传目录本身必须已经存在)
+  static bool make_parent_dirs(const std::string &path);
+  // 是否是布局中第level级(从0开始)的子目录名：第一级两个、第二级一个小写十六进制字符
+  static bool is_shard_name(const char *name, int level);
+};
+
+/*
+    按布局遍历上传目录中的所有文件
+    - 深度优先，同时最多打开LEVELS+1个目录，内存占用与文件数量无关
+    - 跳过以.开头的目录项和不属于布局的目录，返回的顺序是目录项的顺序，不排序
+*/
+class upload_walker
+{
+public:
+  explicit upload_walker(const std::string &dir);
+  ~upload_walker();
+
+  upload_walker(const upload_walker &) = delete;
+  upload_walker &operator=(const upload_walker &) = delete;
+
+  bool ok() const { return m_ok; } // 上传目录是否打开成功
+
+  // 取出下一个目录项，name为文件名，path为实际路径；返回false表示遍历结束
+  bool next(std::string &name, std::string &path);
+
+private:
+  DIR *m_dirs[upload_layout::LEVELS + 1];
+  std::string m_paths[upload_layout::LEVELS + 1];
+  int m_depth; // 当前读取的层，-1表示遍历结束
+  bool m_ok;
+};
+
+#endif
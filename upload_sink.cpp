@@ -0,0 +1,102 @@
+#include "upload_sink.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <algorithm>
+
+upload_sink::upload_sink(const std::string &path, int64_t length)
+    : m_path(path), m_fd(-1), m_remaining(length), m_buf(new char[BUFFER_SIZE]), m_buffered(0), m_committed(false), m_written(0)
+{
+}
+
+upload_sink::~upload_sink()
+{
+  if (m_fd >= 0)
+  {
+    close(m_fd);
+  }
+  if (!m_committed && !m_temp_path.empty())
+  {
+    unlink(m_temp_path.c_str());
+  }
+}
+
+size_t upload_sink::space() const
+{
+  return std::min<uint64_t>(BUFFER_SIZE - m_buffered, m_remaining);
+}
+
+void upload_sink::produced(size_t n)
+{
+  m_buffered += n;
+  m_remaining -= n;
+}
+
+size_t upload_sink::append(const char *data, size_t len)
+{
+  size_t n = std::min(len, space());
+  memcpy(tail(), data, n);
+  produced(n);
+  return n;
+}
+
+bool upload_sink::flush()
+{
+  if (m_fd < 0)
+  {
+    // 临时文件与目标文件在同一目录，存入blob目录的rename是原子的；以.开头，不会出现在文件列表中
+    if (!upload_layout::make_parent_dirs(m_path))
+    {
+      return false;
+    }
+    std::string dir = m_path.substr(0, m_path.rfind('/') + 1);
+    std::string temp = dir + ".upload_XXXXXX";
+    m_fd = mkstemp(&temp[0]);
+    if (m_fd < 0)
+    {
+      printf("创建临时文件失败: %s\n", strerror(errno));
+      return false;
+    }
+    m_temp_path = temp;
+    // mkstemp创建的文件只有属主可读，静态文件需要其他用户可读
+    fchmod(m_fd, 0644);
+  }
+
+  m_hash.update(m_buf.get(), m_buffered);
+  size_t done = 0;
+  while (done < m_buffered)
+  {
+    ssize_t n = ::write(m_fd, m_buf.get() + done, m_buffered - done);
+    if (n < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if (n <= 0)
+    {
+      printf("写入上传文件失败: %s\n", strerror(errno));
+      return false;
+    }
+    done += n;
+  }
+  m_written += m_buffered;
+  m_buffered = 0;
+  return true;
+}
+
+bool upload_sink::commit(bool &existed)
+{
+  if (m_remaining != 0 || !flush())
+  {
+    return false;
+  }
+  close(m_fd);
+  m_fd = -1;
+
+  // 无论成功与否，临时文件都已被移入blob目录或删除
+  m_committed = true;
+  m_digest = m_hash.hex();
+  return content_store::instance().store(m_temp_path, m_digest, m_path, existed);
+}
@@ -0,0 +1,68 @@
+#ifndef UPLOAD_SINK_H
+#define UPLOAD_SINK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <memory>
+#include "content_store.h"
+
+/*
+    流式上传的目标文件
+    - 请求体分批读入固定大小的缓冲区，由磁盘I/O线程写入临时文件，内存占用与文件大小无关
+    - 写入临时文件的同时计算内容的SHA-256，全部写入后交给content_store按内容保存，目标文件原子地替换为指向blob的链接
+    - 读取者要么看到旧文件，要么看到完整的新文件；内容与已有的blob相同时不保留第二份副本
+    - 未提交就销毁时(出错、连接断开)删除临时文件，目标文件保持原样
+    - 同一时刻只被一个线程访问，不需要加锁
+*/
+class upload_sink
+{
+public:
+  static const size_t BUFFER_SIZE = 64 * 1024; // 接收缓冲区大小，也是每次写盘的最大长度
+  static const int64_t UNKNOWN_LENGTH = INT64_MAX; // 分块传输时请求体长度未知，收完后由调用者finish
+
+  // path为目标文件，length为请求体的总长度
+  upload_sink(const std::string &path, int64_t length);
+  ~upload_sink();
+
+  upload_sink(const upload_sink &) = delete;
+  upload_sink &operator=(const upload_sink &) = delete;
+
+  // 接收缓冲区的空闲部分，直接从socket读入后调用produced
+  char *tail() { return m_buf.get() + m_buffered; }
+  size_t space() const;
+  void produced(size_t n);
+
+  // 从内存拷贝请求体，返回拷贝的字节数，缓冲区满或请求体已收完时会少于len
+  size_t append(const char *data, size_t len);
+
+  // 请求体已经结束，不再接收数据；分块传输收到最后一块或解码出错时调用
+  void finish() { m_remaining = 0; }
+
+  int64_t remaining() const { return m_remaining; } // 还没有收到的请求体字节数
+  size_t buffered() const { return m_buffered; }    // 已收到但还没有写入文件的字节数
+  bool ready() const { return m_buffered > 0 || m_remaining == 0; } // 是否有需要磁盘I/O线程处理的数据
+
+  // 以下在磁盘I/O线程中调用
+  // 把缓冲区中的数据写入临时文件，第一次调用时创建临时文件
+  bool flush();
+  // 请求体全部写入后存入内容存储并链接为目标文件，existed返回目标文件原来是否存在
+  bool commit(bool &existed);
+
+  uint64_t size() const { return m_written; }           // 已写入文件的字节数
+  const std::string &hash() const { return m_digest; } // 提交后为内容的SHA-256
+
+private:
+  std::string m_path;
+  std::string m_temp_path;
+  int m_fd;               // 临时文件，尚未创建时为-1
+  int64_t m_remaining;
+  std::unique_ptr<char[]> m_buf;
+  size_t m_buffered;
+  bool m_committed;
+  uint64_t m_written;
+  content_hash m_hash;
+  std::string m_digest;
+};
+
+#endif